@@ -43,6 +43,11 @@ struct CDT_EXPORT VertexInsertionOrder
     {
         Randomized, ///< vertices will be inserted in random order
         AsProvided, ///< vertices will be inserted in the same order as provided
+        /// biased randomized insertion order: random rounds of doubling size,
+        /// each sorted along a Hilbert curve; every vertex is located by
+        /// walking from the previously inserted one instead of querying the
+        /// near-point locator (suited to large, regular inputs like grids)
+        BRIO,
     };
 };
 
@@ -201,6 +206,8 @@ private:
     void addSuperTriangle(const Box2d<T>& box);
     void addNewVertex(const V2d<T>& pos, const TriIndVec& tris);
     void insertVertex(const VertInd iVert);
+    void insertVertex(const VertInd iVert, const VertInd walkStart);
+    void locateBulkInsertedVertices();
     void insertEdge(Edge edge);
     tuple<TriInd, VertInd, VertInd> intersectedTriangle(
         const VertInd iA,
@@ -214,6 +221,8 @@ private:
     insertPointOnEdge(const VertInd v, const TriInd iT1, const TriInd iT2);
     array<TriInd, 2> trianglesAt(const V2d<T>& pos) const;
     array<TriInd, 2> walkingSearchTrianglesAt(const V2d<T>& pos) const;
+    array<TriInd, 2>
+    walkingSearchTrianglesAt(const V2d<T>& pos, const VertInd walkStart) const;
     TriInd walkTriangles(const VertInd startVertex, const V2d<T>& pos) const;
     bool isFlipNeeded(
         const V2d<T>& pos,
@@ -267,6 +276,11 @@ private:
     std::size_t m_nTargetVerts;
     SuperGeometryType::Enum m_superGeomType;
     VertexInsertionOrder::Enum m_vertexInsertionOrder;
+    /// vertices inserted in bulk that are not yet in the near-point locator
+    std::vector<VertInd> m_unlocatedVerts;
+    /// per-instance generator: triangulations on different threads
+    /// neither race nor depend on each other's random sequence
+    mutable mt19937 m_randGen;
 };
 
 /**
@@ -518,23 +532,107 @@ namespace CDT
 {
 
 #ifdef CDT_CXX11_IS_SUPPORTED
-inline void shuffle_indices(std::vector<VertInd>& indices)
+inline void shuffle_indices(std::vector<VertInd>& indices, mt19937& g)
 {
-    static mt19937 g(9001);
     std::shuffle(indices.begin(), indices.end(), g);
 }
 #else
-inline size_t randomCDT(const size_t i)
+inline void shuffle_indices(std::vector<VertInd>& indices, mt19937& g)
 {
-    static mt19937 g(9001);
-    return g() % i;
+    for(std::size_t i = indices.size(); i > 1; --i)
+        std::swap(indices[i - 1], indices[g() % i]);
 }
+#endif
 
-inline void shuffle_indices(std::vector<VertInd>& indices)
+/// Position of (x, y) along a Hilbert curve filling a 2^16 x 2^16 grid
+inline unsigned long long hilbert_index(unsigned int x, unsigned int y)
 {
-    std::random_shuffle(indices.begin(), indices.end(), randomCDT);
+    const unsigned int n = 1u << 16;
+    unsigned long long d = 0;
+    for(unsigned int s = n / 2; s > 0; s /= 2)
+    {
+        const unsigned int rx = (x & s) > 0;
+        const unsigned int ry = (y & s) > 0;
+        d += (unsigned long long)s * s * ((3 * rx) ^ ry);
+        if(ry == 0)
+        {
+            if(rx == 1)
+            {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+/**
+ * Biased randomized insertion order (Amenta, Choi, Rote): shuffle, split into
+ * rounds of doubling size and sort every round along a Hilbert curve.
+ * Consecutive vertices are close, so short walks find their triangles, while
+ * the random rounds keep the expected work of incremental Delaunay.
+ * Every other round runs the curve backwards, so each round starts near where
+ * the previous one ended.
+ */
+template <typename T>
+void brio_indices(
+    std::vector<VertInd>& indices,
+    const std::vector<V2d<T> >& vertices,
+    mt19937& g)
+{
+    typedef std::pair<unsigned long long, VertInd> KeyedVert;
+    const std::size_t minRoundSize = 64;
+    if(indices.empty())
+        return;
+    shuffle_indices(indices, g);
+
+    Box2d<T> box;
+    box.min = box.max = vertices[indices.front()];
+    typedef std::vector<VertInd>::const_iterator CIter;
+    for(CIter it = indices.begin(); it != indices.end(); ++it)
+    {
+        const V2d<T>& v = vertices[*it];
+        box.min.x = std::min(v.x, box.min.x);
+        box.max.x = std::max(v.x, box.max.x);
+        box.min.y = std::min(v.y, box.min.y);
+        box.max.y = std::max(v.y, box.max.y);
+    }
+    const T cells = T((1u << 16) - 1);
+    const T dx = box.max.x - box.min.x;
+    const T dy = box.max.y - box.min.y;
+    const T scale = cells / std::max(std::max(dx, dy), T(1e-12));
+
+    std::vector<KeyedVert> keyed(indices.size());
+    for(std::size_t i = 0; i < indices.size(); ++i)
+    {
+        const V2d<T>& v = vertices[indices[i]];
+        keyed[i] = std::make_pair(
+            hilbert_index(
+                static_cast<unsigned int>((v.x - box.min.x) * scale),
+                static_cast<unsigned int>((v.y - box.min.y) * scale)),
+            indices[i]);
+    }
+
+    // rounds from the last (largest) one back to the first
+    bool forward = true;
+    std::size_t end = keyed.size();
+    while(end > 0)
+    {
+        const std::size_t begin = end > minRoundSize ? end / 2 : 0;
+        if(forward)
+            std::sort(keyed.begin() + begin, keyed.begin() + end);
+        else
+            std::sort(
+                keyed.begin() + begin,
+                keyed.begin() + end,
+                std::greater<KeyedVert>());
+        forward = !forward;
+        end = begin;
+    }
+    for(std::size_t i = 0; i < keyed.size(); ++i)
+        indices[i] = keyed[i].second;
 }
-#endif
 
 //-----------------------
 // Triangulation methods
@@ -568,16 +666,40 @@ void Triangulation<T, TNearPointLocator>::insertVertices(
             insertVertex(VertInd(nExistingVerts + std::distance(first, it)));
         break;
     case VertexInsertionOrder::Randomized:
+    {
         std::vector<VertInd> ii(std::distance(first, last));
         typedef std::vector<VertInd>::iterator Iter;
         VertInd value = nExistingVerts;
         for(Iter it = ii.begin(); it != ii.end(); ++it, ++value)
             *it = value;
-        shuffle_indices(ii);
+        shuffle_indices(ii, m_randGen);
         for(Iter it = ii.begin(); it != ii.end(); ++it)
             insertVertex(*it);
         break;
     }
+    case VertexInsertionOrder::BRIO:
+    {
+        std::vector<VertInd> ii(std::distance(first, last));
+        typedef std::vector<VertInd>::iterator Iter;
+        VertInd value = nExistingVerts;
+        for(Iter it = ii.begin(); it != ii.end(); ++it, ++value)
+            *it = value;
+        brio_indices(ii, vertices, m_randGen);
+        if(ii.empty())
+            break;
+        locateBulkInsertedVertices();
+        VertInd walkStart =
+            m_nearPtLocator.nearPoint(vertices[ii.front()], vertices);
+        for(Iter it = ii.begin(); it != ii.end(); ++it)
+        {
+            insertVertex(*it, walkStart);
+            walkStart = *it;
+        }
+        // the locator is only filled if a later call needs it
+        m_unlocatedVerts.insert(m_unlocatedVerts.end(), ii.begin(), ii.end());
+        break;
+    }
+    }
 }
 
 template <typename T, typename TNearPointLocator>
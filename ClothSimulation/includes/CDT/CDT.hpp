@@ -21,8 +21,6 @@ typedef std::deque<TriInd> TriDeque;
 
 namespace detail
 {
-static mt19937 randGen(9001);
-
 /// Needed for c++03 compatibility (no uniform initialization available)
 template <typename T>
 array<T, 3> arr3(const T& v0, const T& v1, const T& v2)
@@ -38,6 +36,7 @@ Triangulation<T, TNearPointLocator>::Triangulation()
     : m_nTargetVerts(0)
     , m_superGeomType(SuperGeometryType::SuperTriangle)
     , m_vertexInsertionOrder(VertexInsertionOrder::Randomized)
+    , m_randGen(9001)
 {}
 
 template <typename T, typename TNearPointLocator>
@@ -46,6 +45,7 @@ Triangulation<T, TNearPointLocator>::Triangulation(
     : m_nTargetVerts(0)
     , m_superGeomType(SuperGeometryType::SuperTriangle)
     , m_vertexInsertionOrder(vertexInsertionOrder)
+    , m_randGen(9001)
 {}
 
 template <typename T, typename TNearPointLocator>
@@ -56,6 +56,7 @@ Triangulation<T, TNearPointLocator>::Triangulation(
     , m_nearPtLocator(nearPtLocator)
     , m_superGeomType(SuperGeometryType::SuperTriangle)
     , m_vertexInsertionOrder(vertexInsertionOrder)
+    , m_randGen(9001)
 {}
 
 template <typename T, typename TNearPointLocator>
@@ -125,6 +126,7 @@ void Triangulation<T, TNearPointLocator>::eraseSuperTriangleVertices()
 
     vertices = std::vector<V2d<T> >(vertices.begin() + 3, vertices.end());
     vertTris = VerticesTriangles(vertTris.begin() + 3, vertTris.end());
+    m_unlocatedVerts.clear();
 }
 
 template <typename T, typename TNearPointLocator>
@@ -434,9 +436,30 @@ void Triangulation<T, TNearPointLocator>::addNewVertex(
 
 template <typename T, typename TNearPointLocator>
 void Triangulation<T, TNearPointLocator>::insertVertex(const VertInd iVert)
+{
+    locateBulkInsertedVertices();
+    insertVertex(iVert, m_nearPtLocator.nearPoint(vertices[iVert], vertices));
+    m_nearPtLocator.addPoint(iVert, vertices);
+}
+
+template <typename T, typename TNearPointLocator>
+void Triangulation<T, TNearPointLocator>::locateBulkInsertedVertices()
+{
+    typedef std::vector<VertInd>::const_iterator CIt;
+    for(CIt it = m_unlocatedVerts.begin(); it != m_unlocatedVerts.end(); ++it)
+        m_nearPtLocator.addPoint(*it, vertices);
+    m_unlocatedVerts.clear();
+}
+
+/// Insert a vertex, walking to its triangle from walkStart; does not update
+/// the near-point locator
+template <typename T, typename TNearPointLocator>
+void Triangulation<T, TNearPointLocator>::insertVertex(
+    const VertInd iVert,
+    const VertInd walkStart)
 {
     const V2d<T>& v = vertices[iVert];
-    array<TriInd, 2> trisAt = walkingSearchTrianglesAt(v);
+    array<TriInd, 2> trisAt = walkingSearchTrianglesAt(v, walkStart);
     std::stack<TriInd> triStack =
         trisAt[1] == noNeighbor
             ? insertPointInTriangle(iVert, trisAt[0])
@@ -457,8 +480,6 @@ void Triangulation<T, TNearPointLocator>::insertVertex(const VertInd iVert)
             triStack.push(iTopo);
         }
     }
-
-    m_nearPtLocator.addPoint(iVert, vertices);
 }
 
 /*!
@@ -647,19 +668,16 @@ TriInd Triangulation<T, TNearPointLocator>::walkTriangles(
     const V2d<T>& pos) const
 {
     // begin walk in search of triangle at pos
+    // no visited set: with a random first edge the walk cannot cycle forever
+    // (Devillers, Pion, Teillaud: "Walking in a triangulation")
     TriInd currTri = vertTris[startVertex][0];
-#ifdef CDT_USE_BOOST
-    TriIndFlatUSet visited;
-#else
-    TriIndUSet visited;
-#endif
     bool found = false;
     while(!found)
     {
         const Triangle& t = triangles[currTri];
         found = true;
         // stochastic offset to randomize which edge we check first
-        const Index offset(detail::randGen() % 3);
+        const Index offset(m_randGen() % 3);
         for(Index i_(0); i_ < Index(3); ++i_)
         {
             const Index i((i_ + offset) % 3);
@@ -668,8 +686,7 @@ TriInd Triangulation<T, TNearPointLocator>::walkTriangles(
             const PtLineLocation::Enum edgeCheck =
                 locatePointLine(pos, vStart, vEnd);
             if(edgeCheck == PtLineLocation::Right &&
-               t.neighbors[i] != noNeighbor &&
-               visited.insert(t.neighbors[i]).second)
+               t.neighbors[i] != noNeighbor)
             {
                 found = false;
                 currTri = t.neighbors[i];
@@ -684,10 +701,18 @@ template <typename T, typename TNearPointLocator>
 array<TriInd, 2> Triangulation<T, TNearPointLocator>::walkingSearchTrianglesAt(
     const V2d<T>& pos) const
 {
-    array<TriInd, 2> out = {noNeighbor, noNeighbor};
     // Query  for a vertex close to pos, to start the search
-    const VertInd startVertex = m_nearPtLocator.nearPoint(pos, vertices);
-    const TriInd iT = walkTriangles(startVertex, pos);
+    return walkingSearchTrianglesAt(
+        pos, m_nearPtLocator.nearPoint(pos, vertices));
+}
+
+template <typename T, typename TNearPointLocator>
+array<TriInd, 2> Triangulation<T, TNearPointLocator>::walkingSearchTrianglesAt(
+    const V2d<T>& pos,
+    const VertInd walkStart) const
+{
+    array<TriInd, 2> out = {noNeighbor, noNeighbor};
+    const TriInd iT = walkTriangles(walkStart, pos);
     // Finished walk, locate point in current triangle
     const Triangle& t = triangles[iT];
     const V2d<T>& v1 = vertices[t.vertices[0]];
@@ -27,14 +27,18 @@
 #include <algorithm>
 #include <string>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 #include <cmath>
+#include <charconv>
 
 #include "dl_attributes.h"
 #include "dl_codes.h"
 #include "dl_creationadapter.h"
 #include "dl_writer_ascii.h"
 
+#include "../../src/FileCache.h"
+
 #include "iostream"
 
 /**
@@ -150,6 +154,41 @@ bool DL_Dxf::in(std::istream& stream,
 
 
 
+/**
+ * Reads the given file through a memory mapping instead of stdio.
+ *
+ * Lines are split in place and group codes are parsed straight from
+ * the mapped bytes. Only the group value is copied, into the reused
+ * \p groupValue string, so the callbacks of \p creationInterface
+ * receive exactly what \p in() would pass them.
+ *
+ * Numbers are parsed locale independently, so unlike \p in() the
+ * global locale is left untouched.
+ *
+ * @retval true If \p file could be opened.
+ * @retval false If \p file could not be opened.
+ */
+bool DL_Dxf::inMapped(const std::string& file, DL_CreationInterface* creationInterface) {
+    MappedFile mapped(file);
+    if (!mapped.isOpen()) {
+        return false;
+    }
+    if (mapped.data==NULL) {
+        // empty file or the mapping was refused:
+        return in(file, creationInterface);
+    }
+
+    firstCall = true;
+    currentObjectType = DL_UNKNOWN;
+
+    const char* pos = mapped.data;
+    const char* end = mapped.data + mapped.size;
+    while (readDxfGroups(pos, end, creationInterface)) {}
+    return true;
+}
+
+
+
 /**
  * @brief Reads a group couplet from a DXF file.  Calls another function
  * to process it.
@@ -214,6 +253,32 @@ bool DL_Dxf::readDxfGroups(std::istream& stream,
 
 
 
+/**
+ * Same as above but for a memory mapped buffer. \p pos is advanced
+ * past the couplet.
+ */
+bool DL_Dxf::readDxfGroups(const char*& pos, const char* end,
+                           DL_CreationInterface* creationInterface) {
+
+    std::string_view code;
+    std::string_view value;
+
+    // Read one group of the DXF file without copying the code line:
+    if (DL_Dxf::getStrippedLine(code, pos, end) &&
+            DL_Dxf::getStrippedLine(value, pos, end, false) ) {
+
+        groupCode = (unsigned int)toInt(code.data(), code.data() + code.size());
+        groupValue.assign(value.data(), value.size());
+
+        creationInterface->processCodeValuePair(groupCode, groupValue);
+        processDXFGroup(creationInterface, groupCode, groupValue);
+    }
+
+    return pos<end;
+}
+
+
+
 /**
  * @brief Reads line from file & strips whitespace at start and newline 
  * at end.
@@ -286,6 +351,43 @@ bool DL_Dxf::getStrippedLine(std::string &s, unsigned int size,
 
 
 
+/**
+ * Same as above but for a memory mapped buffer. \p s points into
+ * the buffer, so no line is copied or allocated.
+ */
+bool DL_Dxf::getStrippedLine(std::string_view& s, const char*& pos,
+                             const char* end, bool stripSpace) {
+    if (pos>=end) {
+        s = std::string_view();
+        return false;
+    }
+
+    const char* first = pos;
+    const char* last = static_cast<const char*>(memchr(pos, '\n', end-pos));
+    if (last==NULL) {
+        last = end;
+        pos = end;
+    } else {
+        pos = last + 1;
+    }
+
+    // Strip trailing CR and whitespace, then leading whitespace:
+    while (last>first &&
+           (last[-1]==13 || (stripSpace && (last[-1]==' ' || last[-1]=='\t')))) {
+        --last;
+    }
+    if (stripSpace) {
+        while (first<last && (*first==' ' || *first=='\t')) {
+            ++first;
+        }
+    }
+
+    s = std::string_view(first, last-first);
+    return true;
+}
+
+
+
 /**
  * @brief Strips leading whitespace and trailing Carriage Return (CR)
  * and Line Feed (LF) from NULL terminated string.
@@ -5276,6 +5378,51 @@ int DL_Dxf::getLibVersion(const std::string& str) {
     }
 }
 
+/**
+ * Converts the characters in [first, last) into an int, like strtol()
+ * with base 10: leading whitespace and a sign are accepted, trailing
+ * garbage is ignored and 0 is returned if there are no digits.
+ */
+int DL_Dxf::toInt(const char* first, const char* last) {
+    while (first<last && (*first==' ' || *first=='\t')) {
+        ++first;
+    }
+    if (first<last && *first=='+') {
+        ++first;
+    }
+    long long ret = 0;
+    std::from_chars(first, last, ret);
+    return (int)ret;
+}
+
+
+
+/**
+ * Converts the characters in [first, last) into a double. A decimal
+ * comma is accepted in place of the decimal point. Leading whitespace
+ * and a sign are accepted, 0 is returned if there is no number.
+ */
+double DL_Dxf::toReal(const char* first, const char* last) {
+    while (first<last && (*first==' ' || *first=='\t')) {
+        ++first;
+    }
+    if (first<last && *first=='+') {
+        ++first;
+    }
+    double ret = 0.0;
+    std::from_chars_result res = std::from_chars(first, last, ret);
+    if (res.ptr<last && *res.ptr==',') {
+        // make sure the real value uses '.' not ',':
+        std::string str(first, last);
+        std::replace(str.begin(), str.end(), ',', '.');
+        ret = 0.0;
+        std::from_chars(str.data(), str.data() + str.size(), ret);
+    }
+    return ret;
+}
+
+
+
 /**
  * Converts the given string into a double or returns the given
  * default valud (def) if value is NULL or empty.
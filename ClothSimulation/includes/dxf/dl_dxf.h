@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <map>
 
@@ -138,6 +139,13 @@ public:
     static bool getStrippedLine(std::string& s, unsigned int size,
                                std::istream& stream, bool stripSpace = true);
 
+    bool inMapped(const std::string& file,
+                  DL_CreationInterface* creationInterface);
+    bool readDxfGroups(const char*& pos, const char* end,
+                       DL_CreationInterface* creationInterface);
+    static bool getStrippedLine(std::string_view& s, const char*& pos,
+                               const char* end, bool stripSpace = true);
+
     static bool stripWhiteSpace(char** s, bool stripSpaces = true);
 
     bool processDXFGroup(DL_CreationInterface* creationInterface,
@@ -418,10 +426,11 @@ public:
     }
 
     int toInt(const std::string& str) {
-        char* p;
-        return strtol(str.c_str(), &p, 10);
+        return toInt(str.data(), str.data() + str.size());
     }
 
+    static int toInt(const char* first, const char* last);
+
     int getInt16Value(int code, int def) {
         if (!hasValue(code)) {
             return def;
@@ -435,8 +444,7 @@ public:
     }
 
     bool toBool(const std::string& str) {
-        char* p;
-        return (bool)strtol(str.c_str(), &p, 10);
+        return toInt(str) != 0;
     }
 
     std::string getStringValue(int code, const std::string& def) {
@@ -454,17 +462,11 @@ public:
     }
 
     double toReal(const std::string& str) {
-        double ret;
-        // make sure the real value uses '.' not ',':
-        std::string str2 = str;
-        std::replace(str2.begin(), str2.end(), ',', '.');
-        // make sure c++ expects '.' not ',':
-        std::istringstream istr(str2);
-        //istr.imbue(std::locale("C"));
-        istr >> ret;
-        return ret;
+        return toReal(str.data(), str.data() + str.size());
     }
 
+    static double toReal(const char* first, const char* last);
+
 private:
     DL_Codes::version version;
 
@@ -0,0 +1,106 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Defaults
+const size_t ARENA_BLOCK_SIZE = size_t(64) << 10;   // bytes of a block when no larger reservation was made
+
+/*
+ * bump allocator: objects are carved out of a few large blocks and freed all together by release()
+ * only for trivially destructible types, their destructors are never run
+ */
+class Arena
+{
+public:
+    Arena(size_t blockSize = ARENA_BLOCK_SIZE) : blockSize(blockSize)
+    {
+    }
+
+    ~Arena()
+    {
+        release();
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena never runs destructors");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /*
+     * make sure the next 'bytes' can be allocated from a single block
+     */
+    void reserve(size_t bytes)
+    {
+        if (size_t(end - cursor) < bytes) {
+            grow(bytes);
+        }
+    }
+
+    void* allocate(size_t bytes, size_t alignment)
+    {
+        char* p = align(cursor, alignment);
+        if (cursor == nullptr || p + bytes > end) {
+            grow(bytes + alignment);
+            p = align(cursor, alignment);
+        }
+        cursor = p + bytes;
+        used += bytes;
+        return p;
+    }
+
+    /*
+     * free every block; all objects created so far are gone
+     */
+    void release()
+    {
+        for (char* block : blocks) {
+            free(block);
+        }
+        blocks.clear();
+        cursor = end = nullptr;
+        used = 0;
+    }
+
+    size_t bytesUsed() const
+    {
+        return used;
+    }
+
+private:
+    size_t blockSize;
+    std::vector<char*> blocks;
+    char* cursor = nullptr;
+    char* end = nullptr;
+    size_t used = 0;
+
+    static char* align(char* p, size_t alignment)
+    {
+        return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(p) + alignment - 1) & ~uintptr_t(alignment - 1));
+    }
+
+    void grow(size_t bytes)
+    {
+        const size_t size = bytes > blockSize ? bytes : blockSize;
+        char* block = static_cast<char*>(malloc(size));
+        if (block == nullptr) {
+            throw std::bad_alloc();
+        }
+        blocks.push_back(block);
+        cursor = block;
+        end = block + size;
+    }
+};
+
+#endif
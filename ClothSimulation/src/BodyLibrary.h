@@ -0,0 +1,138 @@
+#ifndef BODY_LIBRARY_H
+#define BODY_LIBRARY_H
+
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "Model.h"
+
+// Defaults
+const size_t BODY_LIBRARY_BUDGET = size_t(512) << 20;    // bytes of geometry and collision maps kept for idle bodies
+
+/*
+ * avatars loaded once and handed out as shared models
+ * files with identical content share one Model, so its collision maps are rendered once for all of them,
+ * and every model of the library shares textures by path
+ * bodies nobody holds anymore stay loaded until the library exceeds its budget, then the least recently used go first
+ * a path is hashed once, on its first use; a shared model resolves textures relative to the file it was loaded from
+ * all calls need the GL context, a body is released on the thread that drops the last reference to it
+ */
+class BodyLibrary
+{
+public:
+    std::string cacheDir;       // body cache folder, see Model
+    size_t memoryBudget;
+
+    BodyLibrary(const std::string& cacheDir = "", size_t memoryBudget = BODY_LIBRARY_BUDGET)
+        : cacheDir(cacheDir), memoryBudget(memoryBudget)
+    {
+    }
+
+    ~BodyLibrary()
+    {
+        clear();
+    }
+
+    BodyLibrary(const BodyLibrary&) = delete;
+    BodyLibrary& operator=(const BodyLibrary&) = delete;
+
+    /*
+     * the body of a model file, loaded on first use; nullptr if the file could not be read
+     */
+    std::shared_ptr<Model> get(const std::string& path)
+    {
+        uint64_t source;
+        auto known = sources.find(path);
+        if (known != sources.end())
+        {
+            source = known->second;
+        }
+        else
+        {
+            if (!ModelCache::hashFile(path, source))
+            {
+                std::cout << "[BodyLibrary] " << path << " could not be opened." << std::endl;
+                return nullptr;
+            }
+            sources[path] = source;
+        }
+
+        auto it = bodies.find(source);
+        if (it != bodies.end())
+        {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->model;
+        }
+
+        std::shared_ptr<Model> model(new Model(path, false, cacheDir, &textures), [](Model* m) {
+            m->release();
+            delete m;
+        });
+        if (model->meshes.empty())
+        {
+            sources.erase(path);
+            return nullptr;
+        }
+        lru.push_front(Entry{ source, model });
+        bodies[source] = lru.begin();
+        trim();
+        return model;
+    }
+
+    /*
+     * evict idle bodies, least recently used first, until the library fits its budget
+     * collision maps rendered since a body was loaded are counted as well
+     */
+    void trim()
+    {
+        size_t bytes = memoryBytes();
+        for (auto it = lru.end(); bytes > memoryBudget && it != lru.begin();)
+        {
+            --it;
+            if (it->model.use_count() > 1)
+                continue;
+            bytes -= it->model->memoryBytes();
+            bodies.erase(it->source);
+            it = lru.erase(it);
+        }
+    }
+
+    /*
+     * drop every body the library holds; bodies still in use are released by their last holder
+     */
+    void clear()
+    {
+        bodies.clear();
+        lru.clear();
+    }
+
+    size_t size() const
+    {
+        return lru.size();
+    }
+
+    size_t memoryBytes() const
+    {
+        size_t bytes = 0;
+        for (const Entry& entry : lru)
+            bytes += entry.model->memoryBytes();
+        return bytes;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t source;    // hash of the model file
+        std::shared_ptr<Model> model;
+    };
+
+    TextureRegistry textures;
+    std::list<Entry> lru;   // most recently used first
+    std::map<uint64_t, std::list<Entry>::iterator> bodies;
+    std::map<std::string, uint64_t> sources;
+};
+
+#endif
@@ -1,21 +1,49 @@
 ﻿#ifndef CLOTH_H
 #define CLOTH_H
 
+#include <algorithm>
+#include <atomic>
+#include <float.h>
 #include <vector>
 
+#include "Arena.h"
+#include "Hinge.h"
+#include "Material.h"
 #include "Spring.h"
 #include "ModelRender.h"
 #include "utils.hpp"
 
 // Default Cloth Values
-const float STRUCTURAL_COEF = 700.0;
-const float SHEAR_COEF = 700.0;
-const float BENDING_COEF = 700.0;
 const float SCALE_COEF = 0.0105;
 const int MAX_COLLISION_TIME = 700;
+const size_t SPRING_FORCE_GRAIN = 4096;     // springs per task of the parallel force pass; smaller cloths stay serial
+const float MAX_STRAIN = 0.1f;              // springs are kept within 10% above their rest length by strainLimit()
+const int STRAIN_LIMIT_ITERATIONS = 3;
+const float MIN_MASS_FRACTION = 0.25f;      // lightest node relative to a node of a full grid cell, for slivers along the contour
 
-// unique identifier of cloth, used to select cloths
-int clothNumber = 0;
+/*
+ * unique identifiers of cloths (used to select cloths) and of their nodes (used by cloth self collision)
+ * every Scene counts its own; defaultIds serves cloths created outside of a scene
+ */
+struct IdCounters
+{
+    std::atomic<int> cloths{ 0 };
+    std::atomic<int> nodes{ 0 };   // every creator reserves one contiguous range for its nodes
+};
+IdCounters defaultIds;
+
+class Cloth;
+
+/*
+ * replaces the explicit per-node integration in Cloth::update
+ * called after spring forces have been accumulated into Node::force
+ */
+class ClothSolver
+{
+public:
+    virtual ~ClothSolver() {}
+    virtual void integrate(Cloth* cloth, float timeStep) = 0;
+};
 
 enum Draw_Mode
 {
@@ -30,9 +58,7 @@ public:
     static Draw_Mode drawMode;
     static float scaleCoef;
 
-    const float structuralCoef = STRUCTURAL_COEF;
-    const float shearCoef = SHEAR_COEF;
-    const float bendingCoef = BENDING_COEF;
+    Material material;              // set by applyMaterial()
     
     glm::vec3 leftUpper;            // corners of the bounding box
     glm::vec3 rightUpper;
@@ -44,6 +70,8 @@ public:
     int clothID;
     int width;
     int height;
+    float step;                     // grid spacing the cloth was meshed with
+    float stableTimeStep;           // largest explicit step for the springs and masses of the material, see applyMaterial()
     bool isSewed;                   // whether the cloth is sewed
 
     std::vector<Node*> nodes;
@@ -52,12 +80,23 @@ public:
     std::vector<std::vector<Node*>> sewNode;	// nodes to be sewed
     std::vector<std::vector<Node*>> segments;
     std::vector<Spring*> springs;   // springs of cloth
+    std::vector<Hinge> hinges;      // bending stencils, one per edge shared by two faces, see buildHinges()
+    ClothSolver* solver;            // optional implicit solver, not owned; nullptr means explicit integration
+    float maxStrain;                // elongation kept by strainLimit(), relative to the rest length; <= 0 turns it off
+    int strainIterations;           // passes of strainLimit() over all springs
+    uint32_t revision;              // bumped when springs are created or the material changes; solvers rebuild on it
 
-    Cloth(glm::vec3 position, float minX, float maxX, float minY, float maxY)
+    Cloth(glm::vec3 position, float minX, float maxX, float minY, float maxY, IdCounters& ids = defaultIds)
     {
         width = int(maxX - minX);
         height = int(maxY - minY);
-        clothID = ++clothNumber;
+        clothID = ++ids.cloths;
+        step = 0.0f;
+        stableTimeStep = FLT_MAX;
+        solver = nullptr;
+        revision = 0;
+        maxStrain = MAX_STRAIN;
+        strainIterations = STRAIN_LIMIT_ITERATIONS;
         isSewed = false;
         collisionCount = 0;
 
@@ -72,17 +111,113 @@ public:
 
     ~Cloth()
     {
-        for (int i = 0; i < nodes.size(); i++) {
-            delete nodes[i];
-        }
-        for (int i = 0; i < springs.size(); i++) {
-            delete springs[i];
-        }
+        // nodes and springs live in the arena, which frees them all at once
         nodes.clear();
         springs.clear();
+        hinges.clear();
         faces.clear();
     }
+
+    /*
+     * nodes and springs of the cloth are allocated from its arena; they are never freed one by one
+     */
+    Node* createNode(float x, float y, float z)
+    {
+        return arena.create<Node>(x, y, z);
+    }
+
+    Spring* createSpring(Node* n1, Node* n2, float coef)
+    {
+        revision++;
+        return arena.create<Spring>(n1, n2, coef);
+    }
+
+    /*
+     * room for that many nodes and springs in one block, when the sizes are known before building
+     */
+    void reserve(size_t node_sz, size_t spring_sz)
+    {
+        arena.reserve(node_sz * sizeof(Node) + spring_sz * sizeof(Spring) + alignof(Node) + alignof(Spring));
+        nodes.reserve(node_sz);
+        springs.reserve(spring_sz);
+    }
     
+    /*
+     * one hinge for every edge shared by two faces, bending around it from the current (flat) shape
+     * called once the faces are known; edges of only one face (the contour) and of more than two faces do not bend
+     */
+    void buildHinges()
+    {
+        // (edge key, index into faces of the corner opposite to the edge), sorted so both faces of an edge are adjacent
+        std::vector<std::pair<uint64_t, uint32_t>> edges;
+        edges.reserve(faces.size());
+        for (uint32_t i = 0; i < uint32_t(faces.size()); i++) {
+            const uint32_t face = i - i % 3;
+            const int a = faces[face + (i + 1) % 3]->localID;
+            const int b = faces[face + (i + 2) % 3]->localID;
+            edges.push_back({ (uint64_t(uint32_t(std::min(a, b))) << 32) | uint32_t(std::max(a, b)), i });
+        }
+        std::sort(edges.begin(), edges.end());
+
+        hinges.clear();
+        for (size_t j = 0; j < edges.size(); ) {
+            size_t k = j + 1;
+            while (k < edges.size() && edges[k].first == edges[j].first) {
+                k++;
+            }
+            if (k - j == 2) {
+                const uint32_t i = edges[j].second, face = i - i % 3;
+                hinges.push_back(Hinge(faces[face + (i + 1) % 3], faces[face + (i + 2) % 3], faces[i], faces[edges[j + 1].second],
+                    material.bendingStiffness, bendingDamping(), step * scaleCoef));
+            }
+            j = k;
+        }
+        hingeForces.resize(4 * hinges.size());
+    }
+
+    /*
+     * stiffness of every spring from its direction in the pattern, bending and damping from 'm',
+     * and lumped masses: every node gets a third of the area of its triangles times the density,
+     * but no less than MIN_MASS_FRACTION of a node inside the grid, as contour points next to grid points have almost no area
+     * call it once the springs, faces and hinges are built; the rest shape is the pattern, so it may be called any time
+     */
+    void applyMaterial(const Material& m)
+    {
+        material = m;
+        for (Spring* s : springs) {
+            const glm::vec3 d = s->node2->localPosition - s->node1->localPosition;
+            const float length2 = d.x * d.x + d.y * d.y;
+            const float weft = length2 > 0.0f ? d.x * d.x / length2 : 0.5f;   // cos^2 of the angle to the weft
+            const float warp = 1.0f - weft;
+            s->hookCoef = m.weftStiffness * weft * weft + m.warpStiffness * warp * warp + m.shearStiffness * 2.0f * weft * warp;
+            s->dampCoef = m.damping;
+        }
+        for (Hinge& h : hinges) {
+            h.setCoefficients(m.bendingStiffness, bendingDamping());
+        }
+
+        for (Node* n : nodes) {
+            n->mass = 0.0f;
+        }
+        const float areaScale = 0.5f * scaleCoef * scaleCoef * m.density / 3.0f;
+        for (size_t i = 0; i + 2 < faces.size(); i += 3) {
+            const glm::vec3 p = faces[i]->localPosition;
+            const float mass = glm::length(glm::cross(faces[i + 1]->localPosition - p, faces[i + 2]->localPosition - p)) * areaScale;
+            faces[i]->mass += mass;
+            faces[i + 1]->mass += mass;
+            faces[i + 2]->mass += mass;
+        }
+        const float cellSize = step * scaleCoef;
+        const float minMass = cellSize > 0.0f ? MIN_MASS_FRACTION * m.density * cellSize * cellSize : MASS;
+        for (Node* n : nodes) {
+            n->mass = std::max(n->mass, minMass);
+        }
+
+        gatheredSprings = 0;        // the coefficient arrays of the gather are stale
+        computeStableTimeStep();
+        revision++;
+    }
+
     static void modifyDrawMode(Draw_Mode mode)
     {
         drawMode = mode;
@@ -92,10 +227,29 @@ public:
      * update force, movement, collision and normals in every render loop
      */
     void update(float timeStep)
+    {
+        computeForces(timeStep);
+        integrate(timeStep);
+    }
+
+    /*
+     * normals, spring and bending forces; other sources (e.g. seams) may add their forces before integrate()
+     */
+    void computeForces(float timeStep)
     {
         computeFaceNormal();
-        for (Spring* s : springs) {
-            s->computeInternalForce(timeStep);
+        computeSpringForces(timeStep);
+        computeBendingForces();
+    }
+
+    /*
+     * move every node once with the forces accumulated since the last step
+     */
+    void integrate(float timeStep)
+    {
+        if (solver) {
+            solver->integrate(this, timeStep);
+            return;
         }
         for (Node* n : nodes) {
             n->integrate(timeStep);
@@ -103,15 +257,89 @@ public:
     }
 
     /*
-     * collision detection and response with model 
+     * after integrate(): pull over-elongated springs back to (1 + maxStrain) of their rest length, see Spring::strainCorrection
+     * Jacobi iterations with all springs in parallel; every node averages the corrections of its springs in spring order,
+     * so the result does not depend on the number of threads
      */
-    void modelCollision(ModelRender& modelRender) {
-        for (Node* node : nodes) {
-            if (modelRender.collideWithModel(node)) {
-                modelRender.collisionResponse(node);
+    void strainLimit()
+    {
+        if (maxStrain <= 0.0f || !buildSpringGather()) {
+            return;
+        }
+        springCorrections.resize(2 * springs.size());
+        for (int iter = 0; iter < strainIterations; iter++) {
+            std::atomic<bool> stretched(false);
+            threadPool().parallelFor(springs.size(), SPRING_FORCE_GRAIN, [&](size_t begin, size_t end) {
+                bool any = false;
+                for (size_t i = begin; i < end; i++) {
+                    glm::vec3& dx = springCorrections[2 * i];
+                    glm::vec3& dv = springCorrections[2 * i + 1];
+                    if (springs[i]->strainCorrection(maxStrain, dx, dv)) {
+                        any = true;
+                    }
+                    else {
+                        dx = dv = glm::vec3(0.0f);
+                    }
+                }
+                if (any) {
+                    stretched = true;
+                }
+            });
+            if (!stretched) {
+                break;
+            }
+            threadPool().parallelFor(nodes.size(), SPRING_FORCE_GRAIN / 4, [this](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    glm::vec3 dx(0.0f), dv(0.0f);
+                    int count = 0;
+                    for (uint32_t k = springOffsets[i]; k < springOffsets[i + 1]; k++) {
+                        const uint32_t ref = springRefs[k];
+                        const glm::vec3& sx = springCorrections[2 * (ref >> 1)];
+                        if (sx == glm::vec3(0.0f)) {
+                            continue;
+                        }
+                        const glm::vec3& sv = springCorrections[2 * (ref >> 1) + 1];
+                        dx += (ref & 1) ? -sx : sx;
+                        dv += (ref & 1) ? -sv : sv;
+                        count++;
+                    }
+                    if (count > 0) {
+                        nodes[i]->worldPosition += dx / float(count);
+                        nodes[i]->velocity += dv / float(count);
+                    }
+                }
+            });
+        }
+    }
+
+    /*
+     * a cloth stops being simulated after MAX_COLLISION_TIME steps against the model, counted by Scene::step
+     */
+    bool isActive() const
+    {
+        return collisionCount < MAX_COLLISION_TIME;
+    }
+
+    /*
+     * collision detection and response with model; the model is only read, so scenes may share it
+     */
+    void modelCollision(const ModelRender& modelRender) {
+        const size_t count = nodes.size();
+        collisionPositions.resize(count);
+        collisionVelocities.resize(count);
+        collisionHits.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            collisionPositions[i] = nodes[i]->worldPosition;
+            collisionVelocities[i] = nodes[i]->velocity;
+        }
+        if (modelRender.collideBatch(collisionPositions.data(), collisionVelocities.data(), collisionHits.data(), count) > 0) {
+            for (size_t i = 0; i < count; i++) {
+                if (collisionHits[i]) {
+                    nodes[i]->worldPosition = collisionPositions[i];
+                    nodes[i]->velocity = collisionVelocities[i];
+                }
             }
         }
-        collisionCount += 1;
     }
 
     /*
@@ -159,6 +387,149 @@ public:
 
 
 private:
+    Arena arena;
+
+    // springs of every node for the parallel force pass: springRefs[springOffsets[i], springOffsets[i + 1])
+    // are 2 * spring index + 1 if the node is node2 of that spring, in ascending spring order
+    std::vector<uint32_t> springOffsets;
+    std::vector<uint32_t> springRefs;
+    std::vector<glm::vec3> springForces;
+    // copies of the springs, one array per field, so the parallel force pass streams through them
+    std::vector<uint32_t> springEnds;           // localID of node1 and node2 of every spring
+    std::vector<float> springRestLengths;
+    std::vector<float> springStiffness;
+    std::vector<float> springDamping;
+    std::vector<glm::vec3> hingeForces;         // 4 per hinge, in the order of its nodes
+    std::vector<glm::vec3> springCorrections;   // strainLimit: position and velocity correction of node1 of every spring
+    size_t gatheredSprings = 0;
+
+    // scratch arrays of modelCollision, kept to avoid allocating every substep
+    std::vector<glm::vec3> collisionPositions;
+    std::vector<glm::vec3> collisionVelocities;
+    std::vector<uint8_t> collisionHits;
+
+    /*
+     * (re)build the springs of every node and the spring arrays when springs were added or changed;
+     * false if nodes[i]->localID != i
+     */
+    bool buildSpringGather()
+    {
+        if (gatheredSprings == springs.size() && springOffsets.size() == nodes.size() + 1) {
+            return true;
+        }
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (nodes[i]->localID != int(i)) {
+                return false;
+            }
+        }
+        springOffsets.assign(nodes.size() + 1, 0);
+        for (const Spring* s : springs) {
+            springOffsets[s->node1->localID + 1]++;
+            springOffsets[s->node2->localID + 1]++;
+        }
+        for (size_t i = 0; i < nodes.size(); i++) {
+            springOffsets[i + 1] += springOffsets[i];
+        }
+        springRefs.resize(springOffsets.back());
+        std::vector<uint32_t> fill(springOffsets.begin(), springOffsets.end() - 1);
+        for (uint32_t i = 0; i < uint32_t(springs.size()); i++) {
+            springRefs[fill[springs[i]->node1->localID]++] = 2 * i;
+            springRefs[fill[springs[i]->node2->localID]++] = 2 * i + 1;
+        }
+        springForces.resize(springs.size());
+        springEnds.resize(2 * springs.size());
+        springRestLengths.resize(springs.size());
+        springStiffness.resize(springs.size());
+        springDamping.resize(springs.size());
+        for (size_t i = 0; i < springs.size(); i++) {
+            springEnds[2 * i] = uint32_t(springs[i]->node1->localID);
+            springEnds[2 * i + 1] = uint32_t(springs[i]->node2->localID);
+            springRestLengths[i] = springs[i]->restLength;
+            springStiffness[i] = springs[i]->hookCoef;
+            springDamping[i] = springs[i]->dampCoef;
+        }
+        gatheredSprings = springs.size();
+        return true;
+    }
+
+    /*
+     * hinges in parallel, each into its own 4 slots of hingeForces, then added to the nodes in hinge order,
+     * so the result does not depend on the number of threads
+     */
+    void computeBendingForces()
+    {
+        if (hingeForces.size() != 4 * hinges.size()) {
+            hingeForces.resize(4 * hinges.size());
+        }
+        threadPool().parallelFor(hinges.size(), SPRING_FORCE_GRAIN, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                if (!hinges[i].internalForces(&hingeForces[4 * i])) {
+                    std::fill_n(&hingeForces[4 * i], 4, glm::vec3(0.0f));
+                }
+            }
+        });
+        for (size_t i = 0; i < hinges.size(); i++) {
+            for (int k = 0; k < 4; k++) {
+                hinges[i].n[k]->addForce(hingeForces[4 * i + k]);
+            }
+        }
+    }
+
+    /*
+     * Hooke forces of all springs; large cloths in parallel through the gather of buildSpringGather()
+     */
+    void computeSpringForces(float timeStep)
+    {
+        if (springs.size() < 2 * SPRING_FORCE_GRAIN || !buildSpringGather()) {
+            for (Spring* s : springs) {
+                s->computeInternalForce(timeStep);
+            }
+            return;
+        }
+        // springs in parallel, then every node sums its springs in spring order, as the serial loop does,
+        // so the result is bit-identical whatever the number of threads
+        threadPool().parallelFor(springs.size(), SPRING_FORCE_GRAIN, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const Node* n1 = nodes[springEnds[2 * i]];
+                const Node* n2 = nodes[springEnds[2 * i + 1]];
+                springForces[i] = Spring::force(n1->worldPosition, n2->worldPosition, n1->velocity, n2->velocity,
+                    springRestLengths[i], springStiffness[i], springDamping[i]);
+            }
+        });
+        threadPool().parallelFor(nodes.size(), SPRING_FORCE_GRAIN / 4, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                glm::vec3 force = nodes[i]->force;
+                for (uint32_t k = springOffsets[i]; k < springOffsets[i + 1]; k++) {
+                    const uint32_t ref = springRefs[k];
+                    force += (ref & 1) ? -springForces[ref >> 1] : springForces[ref >> 1];
+                }
+                nodes[i]->force = force;
+            }
+        });
+    }
+
+    float bendingDamping() const
+    {
+        return BENDING_DAMPING * material.damping / SPRING_DAMPING;
+    }
+
+    /*
+     * explicit integration of a node is stable while timeStep < 2 / sqrt(lambda), lambda the largest eigenvalue of M^-1 K;
+     * Gershgorin bounds it by the sum over the springs of a node of k * (1 / m_i + 1 / sqrt(m_i m_j))
+     */
+    void computeStableTimeStep()
+    {
+        std::vector<float> bound(nodes.size(), 0.0f);
+        for (const Spring* s : springs) {
+            const float m1 = s->node1->mass, m2 = s->node2->mass;
+            const float mutual = s->hookCoef / sqrtf(m1 * m2);
+            bound[s->node1->localID] += s->hookCoef / m1 + mutual;
+            bound[s->node2->localID] += s->hookCoef / m2 + mutual;
+        }
+        const float lambda = bound.empty() ? 0.0f : *std::max_element(bound.begin(), bound.end());
+        stableTimeStep = lambda > 0.0f ? 2.0f / sqrtf(lambda) : FLT_MAX;
+    }
+
     /*
      * calculate face normals to generate lighting effects
      */
@@ -0,0 +1,297 @@
+#ifndef CLOTH_BVH_H
+#define CLOTH_BVH_H
+
+#include <algorithm>
+#include <float.h>
+#include <vector>
+
+#include "Cloth.h"
+
+// Defaults
+const int BVH_LEAF_SIZE = 4;        // primitives per leaf
+const int BVH_STACK_SIZE = 64;      // deeper than any tree of median splits over a cloth
+
+struct RayHit
+{
+    float t = FLT_MAX;              // distance along the ray, in units of its direction
+    glm::vec3 point;
+    Node* node = nullptr;           // corner of the hit triangle closest to the hit point
+};
+
+struct ContourHit
+{
+    float distance = FLT_MAX;
+    glm::vec3 point;                // closest point on the contour
+    Node* node = nullptr;           // end of the closest edge nearer to 'point'
+    int segment = -1;               // index into Cloth::segments
+};
+
+/*
+ * bounding volume hierarchies of a cloth in world space: one over its triangles for ray picking,
+ * one over the edges of its segments for nearest contour queries
+ * the trees are built once; refit() updates the bounds after the nodes have moved, keeping the topology
+ */
+class ClothBVH
+{
+public:
+    /*
+     * nothing is built for a cloth without faces or segments; queries then find nothing
+     */
+    void build(const Cloth* cloth) {
+        std::vector<Primitive> prims;
+        for (size_t i = 0; i + 2 < cloth->faces.size(); i += 3) {
+            prims.push_back(Primitive{ { cloth->faces[i], cloth->faces[i + 1], cloth->faces[i + 2] }, -1 });
+        }
+        triangles.build(prims);
+
+        prims.clear();
+        for (int s = 0; s < int(cloth->segments.size()); s++) {
+            const std::vector<Node*>& segment = cloth->segments[s];
+            for (size_t i = 0; i + 1 < segment.size(); i++) {
+                prims.push_back(Primitive{ { segment[i], segment[i + 1], segment[i + 1] }, s });
+            }
+        }
+        edges.build(prims);
+        nodeCount = cloth->nodes.size();
+    }
+
+    /*
+     * whether the cloth has been remeshed since build()
+     */
+    bool isBuiltFor(const Cloth* cloth) const {
+        return nodeCount == cloth->nodes.size();
+    }
+
+    void refit() {
+        triangles.refit();
+        edges.refit();
+    }
+
+    /*
+     * closest triangle along the ray, if any is hit
+     */
+    bool intersect(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit) const {
+        const glm::vec3 inverse = 1.0f / direction;
+        bool found = false;
+        triangles.traverse(
+            [&](const BVHNode& node) { return rayBox(origin, inverse, node, hit.t); },
+            [&](const Primitive& p) {
+                float t;
+                if (rayTriangle(origin, direction, p, t) && t < hit.t) {
+                    hit.t = t;
+                    hit.point = origin + direction * t;
+                    hit.node = nearest(hit.point, p);
+                    found = true;
+                }
+            });
+        return found;
+    }
+
+    /*
+     * closest point on the contour within 'maxDistance'
+     */
+    bool nearestContour(const glm::vec3& point, float maxDistance, ContourHit& hit) const {
+        float best = maxDistance * maxDistance;
+        bool found = false;
+        edges.traverse(
+            [&](const BVHNode& node) { return boxDistance2(point, node) < best; },
+            [&](const Primitive& p) {
+                const glm::vec3 a = p.n[0]->worldPosition, ab = p.n[1]->worldPosition - a;
+                const float length2 = glm::dot(ab, ab);
+                const float t = length2 > 0.0f ? glm::clamp(glm::dot(point - a, ab) / length2, 0.0f, 1.0f) : 0.0f;
+                const glm::vec3 closest = a + ab * t;
+                const glm::vec3 d = point - closest;
+                const float distance2 = glm::dot(d, d);
+                if (distance2 < best) {
+                    best = distance2;
+                    hit.point = closest;
+                    hit.node = t < 0.5f ? p.n[0] : p.n[1];
+                    hit.segment = p.segment;
+                    found = true;
+                }
+            });
+        if (found) {
+            hit.distance = sqrtf(best);
+        }
+        return found;
+    }
+
+private:
+    struct Primitive
+    {
+        Node* n[3];         // an edge repeats its second node
+        int segment;        // edges only
+    };
+
+    struct BVHNode
+    {
+        glm::vec3 min, max;
+        int first;          // leaf: first primitive; inner: index of the right child, the left one follows its parent
+        int count;          // primitives of a leaf, 0 for inner nodes
+    };
+
+    /*
+     * nodes are stored depth first, so children always come after their parent
+     */
+    class Tree
+    {
+    public:
+        void build(std::vector<Primitive>& primitives) {
+            prims.swap(primitives);
+            nodes.clear();
+            if (!prims.empty()) {
+                nodes.reserve(2 * prims.size() / BVH_LEAF_SIZE + 1);
+                split(0, int(prims.size()));
+            }
+        }
+
+        void refit() {
+            for (int i = int(nodes.size()) - 1; i >= 0; i--) {
+                BVHNode& node = nodes[i];
+                if (node.count > 0) {
+                    bounds(node.first, node.first + node.count, node.min, node.max);
+                }
+                else {
+                    const BVHNode& left = nodes[i + 1];
+                    const BVHNode& right = nodes[node.first];
+                    node.min = glm::min(left.min, right.min);
+                    node.max = glm::max(left.max, right.max);
+                }
+            }
+        }
+
+        template <typename Enter, typename Visit>
+        void traverse(Enter enter, Visit visit) const {
+            if (nodes.empty()) {
+                return;
+            }
+            int stack[BVH_STACK_SIZE];
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const BVHNode& node = nodes[stack[--top]];
+                if (!enter(node)) {
+                    continue;
+                }
+                if (node.count > 0) {
+                    for (int i = node.first; i < node.first + node.count; i++) {
+                        visit(prims[i]);
+                    }
+                }
+                else if (top + 2 <= BVH_STACK_SIZE) {
+                    stack[top++] = node.first;
+                    stack[top++] = int(&node - nodes.data()) + 1;
+                }
+            }
+        }
+
+    private:
+        std::vector<BVHNode> nodes;
+        std::vector<Primitive> prims;
+
+        void bounds(int begin, int end, glm::vec3& min, glm::vec3& max) const {
+            min = glm::vec3(FLT_MAX);
+            max = glm::vec3(-FLT_MAX);
+            for (int i = begin; i < end; i++) {
+                for (const Node* n : prims[i].n) {
+                    min = glm::min(min, n->worldPosition);
+                    max = glm::max(max, n->worldPosition);
+                }
+            }
+        }
+
+        static glm::vec3 centroid(const Primitive& p) {
+            return (p.n[0]->worldPosition + p.n[1]->worldPosition + p.n[2]->worldPosition) / 3.0f;
+        }
+
+        /*
+         * median split along the longest axis of the centroids
+         */
+        int split(int begin, int end) {
+            const int index = int(nodes.size());
+            nodes.push_back(BVHNode());
+            glm::vec3 min, max;
+            bounds(begin, end, min, max);
+            nodes[index].min = min;
+            nodes[index].max = max;
+            if (end - begin <= BVH_LEAF_SIZE) {
+                nodes[index].first = begin;
+                nodes[index].count = end - begin;
+                return index;
+            }
+
+            glm::vec3 cmin(FLT_MAX), cmax(-FLT_MAX);
+            for (int i = begin; i < end; i++) {
+                cmin = glm::min(cmin, centroid(prims[i]));
+                cmax = glm::max(cmax, centroid(prims[i]));
+            }
+            const glm::vec3 extent = cmax - cmin;
+            const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+            const int middle = (begin + end) / 2;
+            std::nth_element(prims.begin() + begin, prims.begin() + middle, prims.begin() + end,
+                [axis](const Primitive& a, const Primitive& b) { return centroid(a)[axis] < centroid(b)[axis]; });
+
+            split(begin, middle);
+            const int right = split(middle, end);
+            nodes[index].first = right;
+            nodes[index].count = 0;
+            return index;
+        }
+    };
+
+    Tree triangles;
+    Tree edges;
+    size_t nodeCount = 0;
+
+    static bool rayBox(const glm::vec3& origin, const glm::vec3& inverse, const BVHNode& node, float maxT) {
+        const glm::vec3 t0 = (node.min - origin) * inverse;
+        const glm::vec3 t1 = (node.max - origin) * inverse;
+        const glm::vec3 tMin = glm::min(t0, t1), tMax = glm::max(t0, t1);
+        const float enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+        const float exit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxT));
+        return enter <= exit;
+    }
+
+    static float boxDistance2(const glm::vec3& point, const BVHNode& node) {
+        const glm::vec3 d = glm::max(glm::max(node.min - point, point - node.max), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    }
+
+    /*
+     * Moller-Trumbore, both sides of the triangle count
+     */
+    static bool rayTriangle(const glm::vec3& origin, const glm::vec3& direction, const Primitive& p, float& t) {
+        const glm::vec3 a = p.n[0]->worldPosition;
+        const glm::vec3 e1 = p.n[1]->worldPosition - a, e2 = p.n[2]->worldPosition - a;
+        const glm::vec3 q = glm::cross(direction, e2);
+        const float det = glm::dot(e1, q);
+        if (fabs(det) < 1e-12f) {
+            return false;
+        }
+        const float invDet = 1.0f / det;
+        const glm::vec3 s = origin - a;
+        const float u = glm::dot(s, q) * invDet;
+        if (u < 0.0f || u > 1.0f) {
+            return false;
+        }
+        const glm::vec3 r = glm::cross(s, e1);
+        const float v = glm::dot(direction, r) * invDet;
+        if (v < 0.0f || u + v > 1.0f) {
+            return false;
+        }
+        t = glm::dot(e2, r) * invDet;
+        return t >= 0.0f;
+    }
+
+    static Node* nearest(const glm::vec3& point, const Primitive& p) {
+        Node* best = p.n[0];
+        for (Node* n : p.n) {
+            if (glm::distance(point, n->worldPosition) < glm::distance(point, best->worldPosition)) {
+                best = n;
+            }
+        }
+        return best;
+    }
+};
+
+#endif
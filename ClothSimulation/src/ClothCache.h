@@ -0,0 +1,181 @@
+#ifndef CLOTH_CACHE_H
+#define CLOTH_CACHE_H
+
+#include <deque>
+#include <float.h>
+
+#include "Cloth.h"
+#include "FileCache.h"
+#include "test_creationclass.h"     // point2D
+
+// Defaults
+const uint32_t CLOTH_CACHE_MAGIC = 0x48544c43;  // "CLTH"
+const uint32_t CLOTH_CACHE_VERSION = 3;     // 2: BRIO insertion order picks other diagonals on grid cells; 3: no bending springs
+
+/*
+ * meshed panels of one pattern file, so later runs can skip parsing and triangulation
+ * a cache file is only used if its key matches; the key hashes the source bytes together with the mesh settings
+ * layout (native byte order): magic, version, key, panel count, then per panel
+ *   step, contour points, nodes (local position, meshId, segmentID, turning flag), contour, segments, faces, springs
+ * bending hinges are not stored, they are rebuilt from the faces
+ */
+class ClothCache : public FileCache
+{
+public:
+    /*
+     * <cacheDir>/<stem>-<hash of the source path>.cloth, so files with the same name in different folders do not collide
+     */
+    static std::string pathFor(const std::string& cacheDir, const std::string& file) {
+        return cachePath(cacheDir, file, ".cloth");
+    }
+
+    static bool write(const std::string& path, uint64_t key,
+        const std::deque<std::vector<point2D>>& contours, const std::vector<Cloth*>& cloths) {
+        if (contours.size() != cloths.size()) {
+            return false;
+        }
+        std::string buf;
+        put(buf, CLOTH_CACHE_MAGIC);
+        put(buf, CLOTH_CACHE_VERSION);
+        put(buf, key);
+        put(buf, uint32_t(cloths.size()));
+        for (size_t c = 0; c < cloths.size(); c++) {
+            const Cloth* cloth = cloths[c];
+            put(buf, cloth->step);
+            put(buf, uint32_t(contours[c].size()));
+            for (const point2D& p : contours[c]) {
+                put(buf, p.first);
+                put(buf, p.second);
+            }
+            put(buf, uint32_t(cloth->nodes.size()));
+            for (const Node* n : cloth->nodes) {
+                put(buf, n->localPosition.x);
+                put(buf, n->localPosition.y);
+                put(buf, n->localPosition.z);
+                put(buf, int32_t(n->meshId));
+                put(buf, int32_t(n->segmentID));
+                put(buf, uint8_t(n->isTurningPoint));
+            }
+            putNodes(buf, cloth->contour);
+            put(buf, uint32_t(cloth->segments.size()));
+            for (const std::vector<Node*>& segment : cloth->segments) {
+                putNodes(buf, segment);
+            }
+            putNodes(buf, cloth->faces);
+            put(buf, uint32_t(cloth->springs.size()));
+            for (const Spring* s : cloth->springs) {
+                put(buf, uint32_t(s->node1->localID));
+                put(buf, uint32_t(s->node2->localID));
+                put(buf, s->hookCoef);
+            }
+        }
+
+        return store(path, buf);
+    }
+
+    /*
+     * rebuild the cloths of a cache file at 'position'; nothing is added unless the whole file is valid
+     * cloth IDs are taken from 'ids', global node IDs are left to the caller
+     */
+    static bool read(const std::string& path, uint64_t key, glm::vec3 position,
+        std::deque<std::vector<point2D>>& contours, std::vector<Cloth*>& cloths, IdCounters& ids = defaultIds) {
+        MappedFile file(path);
+        if (!file.data) {
+            return false;
+        }
+        Cursor cur{ file.data, file.data + file.size };
+        if (cur.get<uint32_t>() != CLOTH_CACHE_MAGIC || cur.get<uint32_t>() != CLOTH_CACHE_VERSION || cur.get<uint64_t>() != key) {
+            return false;
+        }
+
+        std::deque<std::vector<point2D>> newContours;
+        std::vector<Cloth*> newCloths;
+        const uint32_t cloth_sz = cur.get<uint32_t>();
+        for (uint32_t c = 0; c < cloth_sz && cur.ok; c++) {
+            float step = cur.get<float>();
+            std::vector<point2D> contour(cur.count(8));
+            float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+            for (point2D& p : contour) {
+                p.first = cur.get<float>();
+                p.second = cur.get<float>();
+                minX = std::min(minX, p.first), maxX = std::max(maxX, p.first);
+                minY = std::min(minY, p.second), maxY = std::max(maxY, p.second);
+            }
+            if (!cur.ok) {
+                break;
+            }
+
+            Cloth* cloth = new Cloth(position, minX, maxX, minY, maxY, ids);
+            cloth->step = step;
+            newCloths.push_back(cloth);
+            const uint32_t node_sz = cur.count(25);
+            cloth->reserve(node_sz, 0);
+            for (uint32_t i = 0; i < node_sz; i++) {
+                float x = cur.get<float>(), y = cur.get<float>(), z = cur.get<float>();
+                Node* n = cloth->createNode(x, y, z);
+                n->meshId = cur.get<int32_t>();
+                n->segmentID = cur.get<int32_t>();
+                n->isTurningPoint = cur.get<uint8_t>() != 0;
+                n->localID = int(i);
+                n->lastWorldPosition = n->worldPosition = cloth->modelMatrix * glm::vec4(n->localPosition, 1.0f);
+                cloth->nodes.push_back(n);
+            }
+            getNodes(cur, cloth->nodes, cloth->contour);
+            const uint32_t seg_sz = cur.count(4);
+            cloth->segments.resize(seg_sz);
+            for (uint32_t s = 0; s < seg_sz; s++) {
+                getNodes(cur, cloth->nodes, cloth->segments[s]);
+            }
+            getNodes(cur, cloth->nodes, cloth->faces);
+            const uint32_t spring_sz = cur.count(12);
+            cloth->reserve(0, spring_sz);
+            for (uint32_t s = 0; s < spring_sz && cur.ok; s++) {
+                uint32_t i1 = cur.get<uint32_t>(), i2 = cur.get<uint32_t>();
+                float coef = cur.get<float>();
+                if (i1 >= node_sz || i2 >= node_sz) {
+                    cur.ok = false;
+                    break;
+                }
+                cloth->springs.push_back(cloth->createSpring(cloth->nodes[i1], cloth->nodes[i2], coef));
+            }
+            cloth->buildHinges();
+            cloth->applyMaterial(cloth->material);
+            newContours.push_back(std::move(contour));
+        }
+
+        if (!cur.ok || cur.pos != cur.end || newCloths.size() != cloth_sz) {
+            for (Cloth* c : newCloths) {
+                delete c;
+            }
+            return false;
+        }
+        for (size_t c = 0; c < newCloths.size(); c++) {
+            contours.push_back(std::move(newContours[c]));
+            cloths.push_back(newCloths[c]);
+        }
+        return true;
+    }
+
+private:
+    static void putNodes(std::string& buf, const std::vector<Node*>& nodes) {
+        put(buf, uint32_t(nodes.size()));
+        for (const Node* n : nodes) {
+            put(buf, uint32_t(n->localID));
+        }
+    }
+
+    static void getNodes(Cursor& cur, const std::vector<Node*>& nodes, std::vector<Node*>& out) {
+        const uint32_t n = cur.count(4);
+        out.reserve(n);
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t id = cur.get<uint32_t>();
+            if (id >= nodes.size()) {
+                cur.ok = false;
+                return;
+            }
+            out.push_back(nodes[id]);
+        }
+    }
+};
+
+#endif
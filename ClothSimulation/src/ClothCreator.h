@@ -1,34 +1,130 @@
 #ifndef CLOTHCREATOR_H
 #define CLOTHCREATOR_H
 
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 #include <CDT/CDT.h>
 #include <dxf/dl_dxf.h>
 #include <dxf/dl_creationadapter.h>
-#include "test_creationclass.h"
+#include "PatternReader.h"
 
 #include "Cloth.h"
+#include "ClothCache.h"
+#include "ClothHierarchy.h"
+#include "ParallelTriangulation.h"
+#include "ThreadPool.h"
 
 // Defaults
 const float STEP = 20.0f;
 const glm::vec3 CLOTH_POSITION = glm::vec3(-3.0f, 9.0f, 0.0f);
-int globalID = 0;
+const float CONFORMING_CLEARANCE = 0.3f;    // grid points closer than this (in steps) to the contour are skipped
+const float CONFORMING_MIN_ANGLE = 20.0f;   // degrees; smaller angles get a Steiner point, see ClothCreator::refine
+const int CONFORMING_REFINE_ROUNDS = 4;
+const float CONTOUR_DUPLICATE = 0.1f;       // in steps; contour points closer than this are one point
+const bool PLACE_INSERTS = false;           // see PatternReader::placeInserts
+
+enum Mesh_Mode
+{
+    MESH_BOUNDING_BOX,  // grid over the whole bounding box, outer triangles erased after triangulation
+    MESH_CONFORMING     // only grid points inside the contour, contour resampled to the target edge length
+};
+
+/*
+ * regular grid laid over the bounding box of one panel
+ * every panel gets its own, so panels can be meshed concurrently
+ */
+struct PanelGrid
+{
+    float step;     // steps between points
+    float minX, maxX, minY, maxY;
+    int nodesPerRow, nodesPerCol;
+
+    PanelGrid(const std::vector<point2D>& panel, float meshStep) {
+        step = meshStep;
+        minX = FLT_MAX, minY = FLT_MAX;
+        maxX = -FLT_MAX, maxY = -FLT_MAX;
+        for (const point2D& p : panel) {
+            updateBoundary(p);
+        }
+        nodesPerRow = round((maxX - minX) / step);  // ڸ, Ҫ,  1
+        nodesPerCol = round((maxY - minY) / step);
+    }
+
+    void updateBoundary(point2D point) {
+        float x = point.first;
+        float y = point.second;
+
+        if (x < minX) minX = x;
+        if (x > maxX) maxX = x;
+
+        if (y < minY) minY = y;
+        if (y > maxY) maxY = y;
+    }
+
+    /*
+     * grid point (i, j) lies at (xAt(i), yAt(j)), for xAt(i) < maxX and yAt(j) < maxY
+     * computed instead of accumulated, so every point is off by one rounding at most, whatever the step
+     */
+    float xAt(int i) const {
+        return minX + float(i) * step;
+    }
+
+    float yAt(int j) const {
+        return minY + float(j) * step;
+    }
+
+    /*
+     * meshId of grid point (i, j), -1 outside of the grid
+     */
+    int idAt(int i, int j) const {
+        if (i >= 0 && i < nodesPerRow && j >= 0 && j < nodesPerCol) {
+            return i + nodesPerRow * j;
+        }
+        else {
+            return -1;
+        }
+    }
+};
 
 class ClothCreator
 {
 public:
     glm::vec3 clothPos = CLOTH_POSITION;     // world position of cloth
     std::vector<Cloth*> cloths;  // cloths parsed from .dxf file;
-    const float step = STEP;     // steps between points
-    float minX, maxX, minY, maxY;
-    int nodesPerRow, nodesPerCol;
+    std::deque<std::vector<point2D>> contours;  // panel contours in file order, cloths[i] is meshed from contours[i]
+    float defaultStep;           // steps between points, used by panels without an override
+    std::vector<float> panelSteps;  // per-panel steps; a value <= 0 (or a missing entry) falls back to defaultStep
+    Mesh_Mode meshMode;
+    float targetEdgeLength = 0.0f;  // MESH_CONFORMING: longest contour edge, in steps; <= 0 means one step
+    float clearance = CONFORMING_CLEARANCE;
+    float minAngle = CONFORMING_MIN_ANGLE;  // MESH_CONFORMING: <= 0 refines long triangles only
+    std::string cacheDir;       // if set, load() reuses or refreshes the mesh cache of the file in this directory
+    bool cacheHit = false;      // cloths came from the cache
+    bool cacheSaved = false;    // cloths were meshed and written to the cache
+    bool verbose = true;        // print per-panel progress
+    IdCounters* ids = &defaultIds;  // where cloth and node IDs come from; a Scene brings its own
 
     // dxf parser
-    Test_CreationClass* creationClass;
-    DL_Dxf* dxf;
+    PatternReader* creationClass = nullptr;
+    DL_Dxf* dxf = nullptr;
+
+    ClothCreator(const std::string& clothFilePath, float meshStep = STEP, const std::vector<float>& panelMeshSteps = {},
+        Mesh_Mode mode = MESH_BOUNDING_BOX)
+        : defaultStep(meshStep), panelSteps(panelMeshSteps), meshMode(mode) {
+        bool opened = load(clothFilePath);
+        assert(opened);
+    }
 
-    ClothCreator(const std::string& clothFilePath) {
-        createCloths(clothFilePath);
+    /*
+     * creator without a file; set the mesh options, then call load()
+     */
+    ClothCreator(float meshStep = STEP, Mesh_Mode mode = MESH_BOUNDING_BOX)
+        : defaultStep(meshStep), meshMode(mode) {
     }
 
     ~ClothCreator() {
@@ -40,51 +136,267 @@ public:
         }
     }
 
+    /*
+     * mesh every panel of a pattern file, or take them from the cache when cacheDir holds an up-to-date one
+     * returns false if the file could not be opened; a creator loads one file only
+     */
+    bool load(const std::string& clothFilePath) {
+        assert(dxf == nullptr && cloths.empty());
+
+        uint64_t key = 0;
+        std::string cachePath;
+        if (!cacheDir.empty()) {
+            uint64_t sourceHash;
+            if (!ClothCache::hashFile(clothFilePath, sourceHash)) {
+                std::cerr << clothFilePath << " could not be opened.\n";
+                return false;
+            }
+            key = cacheKey(sourceHash);
+            cachePath = ClothCache::pathFor(cacheDir, clothFilePath);
+            if (ClothCache::read(cachePath, key, clothPos, contours, cloths, *ids)) {
+                cacheHit = true;
+                assignGlobalIDs(cloths);
+                return true;
+            }
+        }
+
+        if (!createCloths(clothFilePath)) {
+            return false;
+        }
+        if (!cachePath.empty()) {
+            cacheSaved = ClothCache::write(cachePath, key, contours, cloths);
+            if (!cacheSaved) {
+                std::cerr << cachePath << " could not be written.\n";
+            }
+        }
+        return true;
+    }
+
+    float stepOfPanel(size_t panel) const {
+        return panel < panelSteps.size() && panelSteps[panel] > 0.0f ? panelSteps[panel] : defaultStep;
+    }
+
+    /*
+     * mesh one panel repeatedly with the given steps, ordered from coarse (large step) to fine
+     * the levels are owned by the returned hierarchy, not by 'cloths'
+     * if 'finest' is given (a cloth of 'cloths' meshed from the same panel), it becomes the finest level
+     * below the meshed ones and stays owned by the creator
+     */
+    ClothHierarchy* createHierarchy(size_t panel, std::vector<float> steps, Cloth* finest = nullptr) {
+        assert(panel < contours.size());
+        std::sort(steps.begin(), steps.end(), std::greater<float>());
+
+        std::vector<const std::vector<point2D>*> levels(steps.size(), &contours[panel]);
+        ClothHierarchy* hierarchy = new ClothHierarchy();
+        for (Cloth* level : createPanels(levels, steps)) {
+            hierarchy->addLevel(level);
+        }
+        if (finest != nullptr) {
+            hierarchy->addLevel(finest);
+            hierarchy->ownsFinest = false;
+        }
+        return hierarchy;
+    }
+
 private:
     /*
-     * dxf file parser
+     * create cloths using VERTEX data
+     * one task of the pool parses the file, the others mesh every contour as soon as the reader completes it;
+     * large panels wait until the file is read and are then meshed one at a time by the whole pool
+     * Cloth objects (and their clothID) are created by the parsing task and global node IDs assigned afterwards,
+     * both in file order, so the result does not depend on which thread meshed which panel
      */
-    std::vector<std::vector<point2D>>*
-    readClothData(const std::string& clothFilePath) {
-        std::cout << "Reading file " << clothFilePath << "...\n";
+    bool createCloths(const std::string& clothFilePath) {
+        if (verbose) {
+            std::cout << "Reading file " << clothFilePath << "...\n";
+        }
+
+        std::deque<PanelGrid> grids;
+        std::mutex mutex;
+        std::condition_variable ready;
+        size_t parsed = 0, meshed = 0;
+        bool finished = false;
+        std::vector<size_t> large;
+
+        // a dxf file may have multiple cloths, each contour is handed over as soon as it is read
+        creationClass = new PatternReader();
+        creationClass->placeInserts = PLACE_INSERTS;
+        creationClass->segmentLengthOf = [this](size_t panel) {
+            return stepOfPanel(panel) * (meshMode == MESH_CONFORMING && targetEdgeLength > 0.0f ? targetEdgeLength : 1.0f);
+        };
+        creationClass->onContour = [&](std::vector<point2D>&& contour) {
+            PanelGrid grid(contour, stepOfPanel(parsed));
+            Cloth* cloth = createPanel(grid, contour.size());
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                contours.push_back(std::move(contour));
+                grids.push_back(grid);
+                cloths.push_back(cloth);
+                parsed += 1;
+            }
+            ready.notify_one();
+        };
 
-        creationClass = new Test_CreationClass();
         dxf = new DL_Dxf();
-        if (!dxf->in(clothFilePath, creationClass)) { // if file open failed
+        bool opened = true;
+        threadPool().parallelFor(threadPool().size(), [&](size_t task) {
+            if (task == 0) {
+                opened = dxf->inMapped(clothFilePath, creationClass);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished = true;
+                }
+                ready.notify_all();
+            }
+
+            for (;;) {
+                const std::vector<point2D>* contour;
+                const PanelGrid* grid;
+                Cloth* cloth;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    ready.wait(lock, [&] { return meshed < parsed || finished; });
+                    if (meshed == parsed) {
+                        break;
+                    }
+                    contour = &contours[meshed];
+                    grid = &grids[meshed];
+                    cloth = cloths[meshed];
+                    meshed += 1;
+                    if (isLargePanel(*grid, contour->size())) {
+                        large.push_back(meshed - 1);
+                        continue;
+                    }
+                }
+                meshPanel(*contour, *grid, cloth);
+            }
+        });
+
+        if (!opened) { // if file open failed
             std::cerr << clothFilePath << " could not be opened.\n";
-            return nullptr;
+            return false;
+        }
+        std::sort(large.begin(), large.end());
+        for (size_t i : large) {
+            meshPanel(contours[i], grids[i], cloths[i], true);
         }
+        assignGlobalIDs(cloths);
+        return true;
+    }
 
-        return &(creationClass->blockNodes);
+    /*
+     * mesh panels concurrently, one task per panel; large panels afterwards, each by the whole pool
+     */
+    std::vector<Cloth*> createPanels(const std::vector<const std::vector<point2D>*>& panelContours, const std::vector<float>& steps) {
+        std::vector<PanelGrid> grids;
+        std::vector<Cloth*> panels;
+        for (size_t i = 0; i < panelContours.size(); i++) {
+            grids.push_back(PanelGrid(*panelContours[i], steps[i]));
+            panels.push_back(createPanel(grids.back(), panelContours[i]->size()));
+        }
+
+        threadPool().parallelFor(panels.size(), [&](size_t i) {
+            if (!isLargePanel(grids[i], panelContours[i]->size())) {
+                meshPanel(*panelContours[i], grids[i], panels[i]);
+            }
+        });
+        for (size_t i = 0; i < panels.size(); i++) {
+            if (isLargePanel(grids[i], panelContours[i]->size())) {
+                meshPanel(*panelContours[i], grids[i], panels[i], true);
+            }
+        }
+
+        assignGlobalIDs(panels);
+        return panels;
     }
 
     /*
-     * create cloths using VERTEX data
+     * empty cloth over the grid of one panel, filled by meshPanel
      */
-    void createCloths(const std::string& clothFilePath) {
+    Cloth* createPanel(const PanelGrid& grid, size_t contourSize) {
+        if (verbose) {
+            std::cout << "contour size: " << contourSize << " step: " << grid.step << "\n";
+            std::cout << "minX: " << grid.minX
+                << " maxX: " << grid.maxX
+                << " minY: " << grid.minY
+                << " maxY: " << grid.maxY
+                << std::endl;
+        }
+
+        Cloth* cloth = new Cloth(clothPos, grid.minX, grid.maxX, grid.minY, grid.maxY, *ids);
+        cloth->step = grid.step;
+        return cloth;
+    }
 
-        std::vector<std::vector<point2D>>* clothNodes = readClothData(clothFilePath);
-        assert(clothNodes != nullptr);
+    void assignGlobalIDs(const std::vector<Cloth*>& panels) {
+        int node_sz = 0;
+        for (Cloth* cloth : panels) {
+            node_sz += int(cloth->nodes.size());
+        }
+        int id = ids->nodes.fetch_add(node_sz);
+        for (Cloth* cloth : panels) {
+            for (Node* n : cloth->nodes) {
+                n->globalID = id++;
+            }
+            if (verbose) {
+                std::cout << "Initialize cloth with " << cloth->nodes.size() << " nodes and " << cloth->faces.size() / 3 << " triangles\n";
+            }
+        }
+    }
 
-        // a dxf file may have multiple cloths, thus use for loop to retrieve all cloths
-        for (size_t i = 0, clth_sz = clothNodes->size(); i < clth_sz; i++) {
-            // boundary of bounding box
-            minX = FLT_MAX, minY = FLT_MAX;
-            maxX = -FLT_MAX, maxY = -FLT_MAX;
+    /*
+     * everything that changes the meshed result, mixed with the hash of the source file
+     */
+    uint64_t cacheKey(uint64_t sourceHash) const {
+        uint64_t h = ClothCache::hash(&sourceHash, sizeof(sourceHash));
+        h = ClothCache::hash(&defaultStep, sizeof(defaultStep), h);
+        for (float s : panelSteps) {
+            h = ClothCache::hash(&s, sizeof(s), h);
+        }
+        int mode = meshMode;
+        h = ClothCache::hash(&mode, sizeof(mode), h);
+        h = ClothCache::hash(&targetEdgeLength, sizeof(targetEdgeLength), h);
+        h = ClothCache::hash(&clearance, sizeof(clearance), h);
+        h = ClothCache::hash(&minAngle, sizeof(minAngle), h);
+        bool place = PLACE_INSERTS;
+        h = ClothCache::hash(&place, sizeof(place), h);
+        return ClothCache::hash(&CHORD_TOLERANCE, sizeof(CHORD_TOLERANCE), h);
+    }
 
-            // Constrained Delaunay Triangulation(CDT)
-            // ---------------------------------------
-            // initialize data structure
-            CDT::Triangulation<float> cdt;
-            std::vector<CDT::V2d<float>> vertices;
-            std::vector<CDT::Edge> edges;
+    /*
+     * enough grid points to be worth a parallel triangulation
+     * independent of the pool size: the strips choose other diagonals on grid cells than one piece would,
+     * so a panel has to take the same path on any machine
+     */
+    static bool isLargePanel(const PanelGrid& grid, size_t contourSize) {
+        return size_t(grid.nodesPerRow + 1) * size_t(grid.nodesPerCol + 1) + contourSize >= PARALLEL_CDT_MIN_VERTICES;
+    }
 
+    /*
+     * triangulate a closed contour on its grid and build the cloth
+     * 'parallel' splits the triangulation over the pool, for a call made outside of it
+     */
+    void meshPanel(const std::vector<point2D>& panel, const PanelGrid& grid, Cloth* cloth, bool parallel = false) const {
+        // Constrained Delaunay Triangulation(CDT)
+        // ---------------------------------------
+        // initialize data structure
+        // grid points come in x-major rows; BRIO reorders them along a Hilbert curve and locates each by a short walk
+        CDT::Triangulation<float> cdt(CDT::VertexInsertionOrder::BRIO);
+        std::vector<CDT::V2d<float>> vertices;
+        std::vector<CDT::Edge> edges;
+        std::vector<int> gridIds;   // meshId of every vertex, recorded when it is added; -1 for contour and Steiner points
+
+        if (meshMode == MESH_CONFORMING) {
+            addConformingPoints(panel, grid, vertices, edges, gridIds);
+            refine(grid, vertices, edges);
+            gridIds.resize(vertices.size(), -1);
+        }
+        else {
             // add contour points into vertices; contour should be closed
-            for (size_t j = 0, ctr_sz = (*clothNodes)[i].size(); j < ctr_sz; j++) {
-                const point2D& p = (*clothNodes)[i][j];
+            for (size_t j = 0, ctr_sz = panel.size(); j < ctr_sz; j++) {
+                const point2D& p = panel[j];
                 vertices.push_back({ p.first, p.second });
-
-                updateBoundary(p);
+                gridIds.push_back(-1);
 
                 if (j == ctr_sz - 1) {
                     edges.push_back({ CDT::VertInd(0), CDT::VertInd(j) });
@@ -94,39 +406,297 @@ private:
                 }
             }
 
-            nodesPerRow = round((maxX - minX) / step);  // ڸ, Ҫ,  1
-            nodesPerCol = round((maxY - minY) / step);
-            std::cout << "contour size: " << vertices.size() << "\n";
-            std::cout << "minX: " << minX
-                << " maxX: " << maxX
-                << " minY: " << minY
-                << " maxY: " << maxY
-                << std::endl;
-
             // add vertex in the bounding box to generate triangle mesh
             // if the vertex lies outside of contour, eraseOuterTrianglesAndHoles will erase it
-            for (float x = minX; x < maxX; x += step) {
-                for (float y = minY; y < maxY; y += step) {
+            for (int i = 0; grid.xAt(i) < grid.maxX; i++) {
+                for (int j = 0; grid.yAt(j) < grid.maxY; j++) {
                     // there we add regular arranged points, because it's easier to create springs under this circumstances
-                    vertices.push_back({ x, y });
+                    vertices.push_back({ grid.xAt(i), grid.yAt(j) });
+                    gridIds.push_back(grid.idAt(i, j));
                 }
             }
+        }
 
-            // triangulation
-            CDT::RemoveDuplicatesAndRemapEdges(vertices, edges);
+        // triangulation
+        // a duplicate is merged into its first copy, so a grid point lying on the contour stays a contour point
+        const CDT::DuplicatesInfo duplicates = CDT::RemoveDuplicatesAndRemapEdges(vertices, edges);
+        std::vector<int> meshIds(vertices.size(), -1);
+        for (size_t k = gridIds.size(); k-- > 0;) {
+            meshIds[duplicates.mapping[k]] = gridIds[k];
+        }
+        if (!parallel || !ParallelTriangulation::triangulate(vertices, edges, cdt)) {
             cdt.insertVertices(vertices);
             cdt.insertEdges(edges);
             cdt.eraseOuterTrianglesAndHoles();
+        }
+
+        createCloth(cdt, grid, meshIds, cloth);
+    }
+
+    /*
+     * MESH_CONFORMING input for the triangulation
+     * 1. contour edges longer than the target length are split evenly, so boundary spacing matches the grid;
+     *    contour points closer than 'clearance' steps to the previous one are merged into it,
+     *    except for turning points (see isTurn), so short edges and sharp corners of the pattern survive;
+     *    only duplicates closer than CONTOUR_DUPLICATE steps are dropped before turning points are found
+     * 2. grid points are kept only if a scanline pass finds them inside the contour
+     *    and they are at least 'clearance' steps away from every contour edge, which avoids slivers
+     * grid points are placed exactly like MESH_BOUNDING_BOX, and 'gridIds' gets their meshId (-1 for contour points)
+     */
+    void addConformingPoints(const std::vector<point2D>& panel, const PanelGrid& grid,
+        std::vector<CDT::V2d<float>>& vertices, std::vector<CDT::Edge>& edges, std::vector<int>& gridIds) const {
+        const float step = grid.step;
+        const float maxEdge = (targetEdgeLength > 0.0f ? targetEdgeLength : 1.0f) * step;
+        const float minDistance = clearance * step;
+
+        // resampled contour; a turning point removes the merged points before it instead of being merged itself
+        std::vector<char> turning;
+        auto tooClose = [&](const CDT::V2d<float>& a, const CDT::V2d<float>& b) {
+            return glm::length(glm::vec2(a.x - b.x, a.y - b.y)) < minDistance;
+        };
+        auto keep = [&](const CDT::V2d<float>& v, bool turn) {
+            if (turn) {
+                while (!vertices.empty() && !turning.back() && tooClose(vertices.back(), v)) {
+                    vertices.pop_back();
+                    turning.pop_back();
+                }
+            }
+            else if (!vertices.empty() && tooClose(vertices.back(), v)) {
+                return;
+            }
+            vertices.push_back(v);
+            turning.push_back(turn);
+        };
+        std::vector<point2D> corners;
+        for (const point2D& p : panel) {
+            if (corners.empty() || glm::length(glm::vec2(p.first - corners.back().first, p.second - corners.back().second)) >= CONTOUR_DUPLICATE * step) {
+                corners.push_back(p);
+            }
+        }
+        while (corners.size() > 3 && glm::length(glm::vec2(corners.back().first - corners[0].first, corners.back().second - corners[0].second)) < CONTOUR_DUPLICATE * step) {
+            corners.pop_back();
+        }
+        for (size_t j = 0, ctr_sz = corners.size(); j < ctr_sz; j++) {
+            const point2D& o = corners[(j + ctr_sz - 1) % ctr_sz];
+            const point2D& p = corners[j];
+            const point2D& q = corners[(j + 1) % ctr_sz];
+            bool turn = isTurn(glm::vec3(p.first - o.first, p.second - o.second, 0.0f), glm::vec3(q.first - p.first, q.second - p.second, 0.0f));
+            float len = glm::length(glm::vec2(q.first - p.first, q.second - p.second));
+            int pieces = std::max(1, int(ceil(len / maxEdge)));
+            for (int k = 0; k < pieces; k++) {
+                float t = float(k) / pieces;
+                keep({ p.first + t * (q.first - p.first), p.second + t * (q.second - p.second) }, k == 0 && turn);
+            }
+        }
+        while (vertices.size() > 3 && tooClose(vertices.back(), vertices.front())) {
+            if (!turning.back()) {
+                vertices.pop_back();
+                turning.pop_back();
+            }
+            else if (!turning.front()) {
+                vertices.erase(vertices.begin());
+                turning.erase(turning.begin());
+            }
+            else {
+                break;
+            }
+        }
+        const size_t contourSize = vertices.size();
+        gridIds.assign(contourSize, -1);
+        for (size_t j = 0; j < contourSize; j++) {
+            if (j == contourSize - 1) {
+                edges.push_back({ CDT::VertInd(0), CDT::VertInd(j) });
+            }
+            else {
+                edges.push_back({ CDT::VertInd(j), CDT::VertInd(j + 1) });
+            }
+        }
+
+        std::vector<float> xs, ys;
+        for (int i = 0; grid.xAt(i) < grid.maxX; i++) xs.push_back(grid.xAt(i));
+        for (int j = 0; grid.yAt(j) < grid.maxY; j++) ys.push_back(grid.yAt(j));
+
+        // crossings of every contour edge with the grid rows (x values)
+        std::vector<std::vector<float>> rowCross(ys.size());
+        for (size_t j = 0, ctr_sz = panel.size(); j < ctr_sz; j++) {
+            glm::vec2 a(panel[j].first, panel[j].second);
+            glm::vec2 b(panel[(j + 1) % ctr_sz].first, panel[(j + 1) % ctr_sz].second);
+            addCrossings(a.y, b.y, a.x, b.x, ys, rowCross);
+        }
+        for (std::vector<float>& c : rowCross) std::sort(c.begin(), c.end());
+
+        // grid points closer than minDistance to a resampled contour edge, edge by edge over the points around it
+        std::vector<char> nearContour(xs.size() * ys.size(), 0);
+        for (size_t j = 0; j < contourSize; j++) {
+            glm::vec2 a(vertices[j].x, vertices[j].y);
+            glm::vec2 b(vertices[(j + 1) % contourSize].x, vertices[(j + 1) % contourSize].y);
+            size_t i0 = std::lower_bound(xs.begin(), xs.end(), std::min(a.x, b.x) - minDistance) - xs.begin();
+            size_t i1 = std::upper_bound(xs.begin(), xs.end(), std::max(a.x, b.x) + minDistance) - xs.begin();
+            size_t k0 = std::lower_bound(ys.begin(), ys.end(), std::min(a.y, b.y) - minDistance) - ys.begin();
+            size_t k1 = std::upper_bound(ys.begin(), ys.end(), std::max(a.y, b.y) + minDistance) - ys.begin();
+            for (size_t i = i0; i < i1; i++) {
+                for (size_t k = k0; k < k1; k++) {
+                    if (distanceToSegment(glm::vec2(xs[i], ys[k]), a, b) < minDistance) {
+                        nearContour[i * ys.size() + k] = 1;
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 0; i < xs.size(); i++) {
+            for (size_t j = 0; j < ys.size(); j++) {
+                const std::vector<float>& row = rowCross[j];
+                size_t before = std::lower_bound(row.begin(), row.end(), xs[i]) - row.begin();
+                if (before % 2 == 0 || nearContour[i * ys.size() + j]) {  // even-odd rule
+                    continue;
+                }
+                vertices.push_back({ xs[i], ys[j] });
+                gridIds.push_back(grid.idAt(int(i), int(j)));
+            }
+        }
+    }
+
+    /*
+     * MESH_CONFORMING quality refinement after addConformingPoints, in at most CONFORMING_REFINE_ROUNDS rounds:
+     * the points are triangulated and every triangle with an angle below 'minAngle', or with an edge longer
+     * than the diagonal of a target-sized cell, gets a Steiner point at its circumcenter (Ruppert),
+     * or at its centroid if the circumcenter is outside of the panel or within 'clearance' of the contour
+     * the contour is never split, so triangles whose shape is fixed by contour points alone stay as they are
+     * Steiner points are off the grid, so they get no meshId and no shear springs
+     */
+    void refine(const PanelGrid& grid, std::vector<CDT::V2d<float>>& vertices, const std::vector<CDT::Edge>& edges) const {
+        const float step = grid.step;
+        const float maxEdge = (targetEdgeLength > 0.0f ? targetEdgeLength : 1.0f) * step;
+        const float maxLength = 1.01f * sqrtf(2.0f) * std::max(maxEdge, step);    // a grid diagonal is fine
+        const float minDistance = clearance * step;
+        const float minSin = minAngle > 0.0f ? sinf(glm::radians(minAngle)) : 0.0f;
+        const size_t contourSize = edges.size();
+        const float cellSize = minDistance > 0.0f ? minDistance : step;
+        auto cellKey = [](int x, int y) {
+            return uint64_t(uint32_t(x)) << 32 | uint32_t(y);
+        };
+
+        // inside the resampled contour (even-odd) and at least minDistance away from it
+        auto usable = [&](const glm::vec2& c) {
+            bool inside = false;
+            for (size_t j = 0; j < contourSize; j++) {
+                glm::vec2 a(vertices[j].x, vertices[j].y);
+                glm::vec2 b(vertices[(j + 1) % contourSize].x, vertices[(j + 1) % contourSize].y);
+                if (distanceToSegment(c, a, b) < minDistance) {
+                    return false;
+                }
+                if ((a.y > c.y) != (b.y > c.y) && c.x < a.x + (c.y - a.y) / (b.y - a.y) * (b.x - a.x)) {
+                    inside = !inside;
+                }
+            }
+            return inside;
+        };
+        for (int round = 0; round < CONFORMING_REFINE_ROUNDS; round++) {
+            std::vector<CDT::V2d<float>> v = vertices;
+            std::vector<CDT::Edge> e = edges;
+            CDT::RemoveDuplicatesAndRemapEdges(v, e);
+            CDT::Triangulation<float> cdt;
+            cdt.insertVertices(v);
+            cdt.insertEdges(e);
+            cdt.eraseOuterTrianglesAndHoles();
+
+            // points of this round by cells of size minDistance; a new one keeps minDistance from all of them
+            std::unordered_map<uint64_t, std::vector<glm::vec2>> added;
+            const size_t before = vertices.size();
+            for (const CDT::Triangle& tri : cdt.triangles) {
+                glm::vec2 p[3];
+                for (int i = 0; i < 3; i++) {
+                    p[i] = glm::vec2(cdt.vertices[tri.vertices[i]].x, cdt.vertices[tri.vertices[i]].y);
+                }
+                float l[3] = { glm::length(p[1] - p[2]), glm::length(p[2] - p[0]), glm::length(p[0] - p[1]) };
+                std::sort(l, l + 3);
+                const float area2 = fabsf((p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x));
+                // the smallest angle is opposite the shortest edge: sin = 2 * area / (product of the other two)
+                if (area2 >= l[1] * l[2] * minSin && l[2] <= maxLength) {
+                    continue;
+                }
+                glm::vec2 c;
+                if (!circumcenter(p, c) || !usable(c)) {
+                    c = (p[0] + p[1] + p[2]) / 3.0f;
+                    if (!usable(c)) {
+                        continue;
+                    }
+                }
+                const float r = std::min({ glm::length(c - p[0]), glm::length(c - p[1]), glm::length(c - p[2]) });
+                const int cx = int(floorf(c.x / cellSize)), cy = int(floorf(c.y / cellSize));
+                bool crowded = r < minDistance;
+                for (int dx = -1; dx <= 1 && !crowded; dx++) {
+                    for (int dy = -1; dy <= 1 && !crowded; dy++) {
+                        auto it = added.find(cellKey(cx + dx, cy + dy));
+                        if (it != added.end()) {
+                            for (const glm::vec2& q : it->second) {
+                                crowded = crowded || glm::length(c - q) < minDistance;
+                            }
+                        }
+                    }
+                }
+                if (crowded) {
+                    continue;
+                }
+                added[cellKey(cx, cy)].push_back(c);
+                vertices.push_back({ c.x, c.y });
+            }
+            if (vertices.size() == before) {
+                break;
+            }
+        }
+    }
 
-            // create a cloth
-            Cloth* cloth = new Cloth(clothPos, minX, maxX, minY, maxY);
-            createCloth(cdt, cloth);
-            cloths.push_back(cloth);
+    /*
+     * an edge from (u0, v0) to (u1, v1) crosses the scanline u = lines[k] at some v;
+     * half-open [min, max) so a contour vertex lying exactly on a line is counted once
+     */
+    static void addCrossings(float u0, float u1, float v0, float v1,
+        const std::vector<float>& lines, std::vector<std::vector<float>>& crossings) {
+        if (u0 == u1) {
+            return;
+        }
+        float lo = std::min(u0, u1), hi = std::max(u0, u1);
+        size_t k = std::lower_bound(lines.begin(), lines.end(), lo) - lines.begin();
+        for (; k < lines.size() && lines[k] < hi; k++) {
+            float t = (lines[k] - u0) / (u1 - u0);
+            crossings[k].push_back(v0 + t * (v1 - v0));
+        }
+    }
+
+    static float distanceToSegment(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b) {
+        glm::vec2 ab = b - a;
+        float len2 = glm::dot(ab, ab);
+        float t = len2 > 0.0f ? glm::clamp(glm::dot(p - a, ab) / len2, 0.0f, 1.0f) : 0.0f;
+        return glm::length(p - (a + t * ab));
+    }
+
+    /*
+     * false for a degenerate triangle
+     */
+    static bool circumcenter(const glm::vec2 p[3], glm::vec2& c) {
+        glm::vec2 b = p[1] - p[0], d = p[2] - p[0];
+        float det = 2.0f * (b.x * d.y - b.y * d.x);
+        if (fabsf(det) < 1e-12f) {
+            return false;
+        }
+        float b2 = glm::dot(b, b), d2 = glm::dot(d, d);
+        c = p[0] + glm::vec2(d.y * b2 - b.y * d2, b.x * d2 - d.x * b2) / det;
+        return true;
+    }
 
-            // TODO: delete me
-            // for debug purpose
-            if (i == 1) break;
+    /*
+     * 'middle' is a turning point of the contour if the direction changes by more than the threshold there,
+     * v1 = middle - prev, v2 = next - middle; (nearly) coincident neighbours never turn
+     */
+    static bool isTurn(const glm::vec3& v1, const glm::vec3& v2) {
+        float len1 = glm::length(v1);
+        float len2 = glm::length(v2);
+        if (len1 * len2 <= 1e-5) {
+            return false;
         }
+        float cos = glm::dot(v1, v2) / (len1 * len2);
+        return glm::dot(v1, v2) < 0 || (cos < glm::cos(20));
     }
 
     /*
@@ -135,24 +705,29 @@ private:
      * 2. ҵյ
      * 3. ùյ㽫ֳ segments
      * 4. ֵ: structural, shear, bending
+     * 'meshIds' holds the meshId of every entry of cdt.vertices, -1 off the grid
      */
-    void createCloth(CDT::Triangulation<float>& cdt, Cloth* cloth) {
+    void createCloth(CDT::Triangulation<float>& cdt, const PanelGrid& grid, const std::vector<int>& meshIds, Cloth* cloth) const {
         // create Nodes of Cloth from 2D points
-        std::map<int, Node*> idOfNode;  // ¼ӵƬеĵ id, id 
+        std::vector<Node*> idOfNode(size_t(std::max(grid.nodesPerRow * grid.nodesPerCol, 0)), nullptr);  // ¼ӵƬеĵ id, id ǲʱ¼
 
         // triangulation ֮, ĵ㲢ᱻƳ cdt.vertices
         // ֻܴ cdt.triangles ҵбõĵ±
-        std::map<int, Node*> indexOfNode;   // ¼±, ӵ
-        std::map<CDT::VertInd, int> contourIndex;   // store index of nodes lying on the contour
+        std::vector<Node*> indexOfNode(cdt.vertices.size(), nullptr);   // ¼±, ӵ
+        // Ȱϵĵȫ; һѭм, ϵĵ, ޷˳ʱ
+        std::vector<char> onContour(cdt.vertices.size(), 0);   // mark index of nodes lying on the contour
+        cloth->reserve(cdt.vertices.size(), 0);
+        cloth->faces.reserve(cdt.triangles.size() * 3);
         for (const CDT::Edge& e : cdt.fixedEdges) {
-            ++contourIndex[e.v1()];
-            ++contourIndex[e.v2()];
+            onContour[e.v1()] = onContour[e.v2()] = 1;
         }
-        // Ȱϵĵȫ; һѭм, ϵĵ, ޷˳ʱ
-        for (std::map<CDT::VertInd, int>::iterator it = contourIndex.begin(); it != contourIndex.end(); it++) {
-            int index = it->first;
+        for (int index = 0, vtx_sz = cdt.vertices.size(); index < vtx_sz; index++) {
+            if (!onContour[index]) {
+                continue;
+            }
             const CDT::V2d<float>& p = cdt.vertices[index];
             Node* n = newNodeFromIndex(p, cloth, index);
+            n->localID = cloth->nodes.size();
             cloth->nodes.push_back(n);
             cloth->contour.push_back(n);
             indexOfNode[index] = n;
@@ -162,16 +737,17 @@ private:
             for (int i = 0; i < 3; i++) {
                 int index = tri.vertices[i];
                 Node* n = nullptr;
-                if (!indexOfNode.count(index)) {    // ǵһγ
+                if (indexOfNode[index] == nullptr) {    // ǵһγ
                     const CDT::V2d<float>& p = cdt.vertices[index];
                     n = newNodeFromIndex(p, cloth, index);
                     // Ѿӹϵĵ,  id != -1
-                    // (p.x-minX)  (p.y-minY) ض step ı, Կ round ȡ
-                    //  int, ־
-                    n->meshId = getIdFromPos(n->localPosition);
+                    n->meshId = meshIds[index];
+                    n->localID = cloth->nodes.size();
                     cloth->nodes.push_back(n);
                     indexOfNode[index] = n;
-                    idOfNode[n->meshId] = n;
+                    if (n->meshId != -1) {
+                        idOfNode[n->meshId] = n;
+                    }
                 }
                 else {  // ֹ
                     n = indexOfNode[index];
@@ -186,20 +762,14 @@ private:
         // we can get 2 vectors: v1 = middle - prev, v2 = next - middle
         // if theta between (n1, n2) > threshold, then we take 'middle' as a 'turning point'
         Node* prev, * middle, * next;
-        int index;  // index of one of the turning point
+        int index = 0;  // index of one of the turning point
         for (int j = 0, ctr_sz = cloth->contour.size(); j < ctr_sz; j++) {
             middle = cloth->contour[j];
             prev = cloth->contour[(j - 1 + ctr_sz) % ctr_sz];
             next = cloth->contour[(j + 1) % ctr_sz];
 
-            glm::vec3 v1 = middle->worldPosition - prev->worldPosition;
-            glm::vec3 v2 = next->worldPosition - middle->worldPosition;
-            float len1 = glm::length(v1);
-            float len2 = glm::length(v2);
-            assert(len1 * len2 > 1e-5);  // avoid dividing by zero
-
-            float cos = glm::dot(v1, v2) / (len1 * len2);
-            middle->isTurningPoint = glm::dot(v1, v2) < 0 || (cos < glm::cos(20));
+            // (nearly) coincident neighbours, e.g. a grid point lying on the contour next to a contour point, never turn
+            middle->isTurningPoint = isTurn(middle->worldPosition - prev->worldPosition, next->worldPosition - middle->worldPosition);
             if (middle->isTurningPoint) {
                 index = j;  // find a turning point, for segments generation 
             }
@@ -229,7 +799,11 @@ private:
 
         // Generate Springs
         // ----------------------------------------------
-        std::map<std::pair<int, int>, int> springExist;
+        // edges between mesh nodes are packed into a 64-bit key (min id in the high word),
+        // sorted and made unique, so duplicate checks are a binary search instead of a map lookup
+        std::vector<uint64_t> springExist;
+        springExist.reserve(cdt.triangles.size() * 3);
+        cloth->reserve(0, cdt.triangles.size() * 3 + cloth->nodes.size() * 2);
         for (const CDT::Triangle& tri : cdt.triangles) {
             Node* n1 = indexOfNode[tri.vertices[0]];
             Node* n2 = indexOfNode[tri.vertices[1]];
@@ -238,20 +812,22 @@ private:
             int id2 = n2->meshId;
             int id3 = n3->meshId;
 
-            cloth->springs.push_back(new Spring(n1, n2, cloth->structuralCoef));
-            cloth->springs.push_back(new Spring(n1, n3, cloth->structuralCoef));
-            cloth->springs.push_back(new Spring(n2, n3, cloth->structuralCoef));
+            cloth->springs.push_back(cloth->createSpring(n1, n2, cloth->material.warpStiffness));
+            cloth->springs.push_back(cloth->createSpring(n1, n3, cloth->material.warpStiffness));
+            cloth->springs.push_back(cloth->createSpring(n2, n3, cloth->material.warpStiffness));
             // store which two nodes have springs between them already
             if (id1 != -1 && id2 != -1) {
-                ++springExist[{std::min(id1, id2), std::max(id1, id2)}];
+                springExist.push_back(edgeKey(id1, id2));
             }
             if (id1 != -1 && id3 != -1) {
-                ++springExist[{std::min(id1, id3), std::max(id1, id3)}];
+                springExist.push_back(edgeKey(id1, id3));
             }
             if (id2 != -1 && id3 != -1) {
-                ++springExist[{std::min(id2, id3), std::max(id2, id3)}];
+                springExist.push_back(edgeKey(id2, id3));
             }
         }
+        std::sort(springExist.begin(), springExist.end());
+        springExist.erase(std::unique(springExist.begin(), springExist.end()), springExist.end());
         // add shear springs on mesh nodes
         for (int j = 0, node_sz = cloth->nodes.size(); j < node_sz; j++) {
             Node* n = cloth->nodes[j];
@@ -259,62 +835,41 @@ private:
                 continue;
             }
 
-            int id1 = getIdFromPos(n->localPosition + glm::vec3(step, step, 0));
-            int id2 = getIdFromPos(n->localPosition + glm::vec3(-step, step, 0));
-            int id3 = getIdFromPos(n->localPosition + glm::vec3(0, 2 * step, 0));
-            int id4 = getIdFromPos(n->localPosition + glm::vec3(2 * step, 0, 0));
-            if (id1 != -1 && idOfNode.count(id1)) addSpring(cloth, n, idOfNode[id1], cloth->shearCoef, springExist);    // Ͻ
-            if (id2 != -1 && idOfNode.count(id2)) addSpring(cloth, n, idOfNode[id2], cloth->shearCoef, springExist);    // ½
-            if (id3 != -1 && idOfNode.count(id3)) addSpring(cloth, n, idOfNode[id3], cloth->bendingCoef, springExist);  // Ϸ2λ
-            if (id4 != -1 && idOfNode.count(id4)) addSpring(cloth, n, idOfNode[id4], cloth->bendingCoef, springExist);  // ҷ2λ
+            const int col = n->meshId % grid.nodesPerRow, row = n->meshId / grid.nodesPerRow;
+            int id1 = grid.idAt(col + 1, row + 1);
+            int id2 = grid.idAt(col - 1, row + 1);
+            if (id1 != -1 && idOfNode[id1]) addSpring(cloth, n, idOfNode[id1], cloth->material.shearStiffness, springExist);    // Ͻ
+            if (id2 != -1 && idOfNode[id2]) addSpring(cloth, n, idOfNode[id2], cloth->material.shearStiffness, springExist);    // ½
         }
-        // add bending springs on contour
-        for (int j = 0, ctr_sz = cloth->contour.size(); j < ctr_sz; j++) {
-            Node* n1 = cloth->contour[j];
-            Node* n2 = cloth->contour[(j + 2) % ctr_sz];
-            cloth->springs.push_back(new Spring(n1, n2, cloth->bendingCoef));
-        }
-        std::cout << "Initialize cloth with " << cloth->nodes.size() << " nodes and " << cloth->faces.size() / 3 << " triangles\n";
-    }
-
-    void updateBoundary(point2D point) {
-        float x = point.first;
-        float y = point.second;
-
-        if (x < minX) minX = x;
-        if (x > maxX) maxX = x;
-
-        if (y < minY) minY = y;
-        if (y > maxY) maxY = y;
+        // bending acts on the dihedral angles between neighbouring triangles instead of springs two steps apart
+        cloth->buildHinges();
+        // spring stiffness by direction and masses by area, from the default material until the scene assigns one
+        cloth->applyMaterial(cloth->material);
     }
 
-    Node* newNodeFromIndex(const CDT::V2d<float>& position, Cloth* cloth, int index) {
-        Node* n = new Node(position.x, position.y, 0.0f);
+    /*
+     * globalID is assigned by createPanels once every panel is meshed
+     */
+    Node* newNodeFromIndex(const CDT::V2d<float>& position, Cloth* cloth, int index) const {
+        Node* n = cloth->createNode(position.x, position.y, 0.0f);
         n->lastWorldPosition = n->worldPosition = cloth->modelMatrix * glm::vec4(n->localPosition, 1.0f);
-        n->globalID = globalID++;
         return n;
     }
     
+    /*
+     * add a spring between two mesh nodes unless the triangulation already has that edge
+     * the two shear offsets never generate the same pair twice, so springExist stays read-only here
+     */
     void addSpring(
         Cloth* cloth, Node* n1, Node* n2, float coef,
-        std::map<std::pair<int, int>, int>& springExist) {
-        int id1 = std::min(n1->meshId, n2->meshId);
-        int id2 = std::max(n1->meshId, n2->meshId);
-        if (!springExist.count({ id1, id2 })) {
-            cloth->springs.push_back(new Spring(n1, n2, coef));
-            ++springExist[{id1, id2}];
+        const std::vector<uint64_t>& springExist) const {
+        if (!std::binary_search(springExist.begin(), springExist.end(), edgeKey(n1->meshId, n2->meshId))) {
+            cloth->springs.push_back(cloth->createSpring(n1, n2, coef));
         }
     }
 
-    int getIdFromPos(glm::vec3 position) {
-        int x = round((position.x - minX) / step);
-        int y = round((position.y - minY) / step);
-        if (x >= 0 && x < nodesPerRow && y >= 0 && y < nodesPerCol) {
-            return x + nodesPerRow * y;
-        }
-        else {
-            return -1;
-        }
+    static uint64_t edgeKey(int id1, int id2) {
+        return (uint64_t(uint32_t(std::min(id1, id2))) << 32) | uint32_t(std::max(id1, id2));
     }
 };
 
@@ -0,0 +1,174 @@
+#ifndef CLOTH_HIERARCHY_H
+#define CLOTH_HIERARCHY_H
+
+#include <vector>
+#include <float.h>
+
+#include "Cloth.h"
+
+/*
+ * maps every node of a fine level onto the coarse triangle that contains it
+ * nodes[i] are indices into the coarse cloth's nodes, weights[i] the barycentric weights of fine node i
+ */
+struct LevelMapping
+{
+    std::vector<glm::ivec3> nodes;
+    std::vector<glm::vec3> weights;
+};
+
+/*
+ * the same panel meshed at several resolutions, levels[0] is the coarsest
+ * prolongations[l] maps levels[l + 1] onto levels[l]
+ */
+class ClothHierarchy
+{
+public:
+    std::vector<Cloth*> levels;
+    std::vector<LevelMapping> prolongations;
+    bool ownsFinest = true;     // false if the finest level is a cloth of a scene, see ClothCreator::createHierarchy
+
+    ~ClothHierarchy()
+    {
+        for (Cloth* c : levels) {
+            if (c != levels.back() || ownsFinest) {
+                delete c;
+            }
+        }
+        levels.clear();
+        prolongations.clear();
+    }
+
+    Cloth* coarsest() const { return levels.front(); }
+    Cloth* finest() const { return levels.back(); }
+
+    /*
+     * append a finer level and compute its mapping onto the current finest level
+     */
+    void addLevel(Cloth* cloth)
+    {
+        if (!levels.empty()) {
+            prolongations.push_back(buildMapping(levels.back(), cloth));
+        }
+        levels.push_back(cloth);
+    }
+
+    /*
+     * seed levels[level + 1] with the state of levels[level]
+     * positions and velocities are interpolated, so a settled coarse drape becomes the fine starting point
+     */
+    void prolongate(size_t level)
+    {
+        assert(level + 1 < levels.size());
+        const std::vector<Node*>& coarse = levels[level]->nodes;
+        const std::vector<Node*>& fine = levels[level + 1]->nodes;
+        const LevelMapping& mapping = prolongations[level];
+
+        for (size_t i = 0, node_sz = fine.size(); i < node_sz; i++) {
+            const glm::ivec3& t = mapping.nodes[i];
+            const glm::vec3& w = mapping.weights[i];
+            Node* n1 = coarse[t.x];
+            Node* n2 = coarse[t.y];
+            Node* n3 = coarse[t.z];
+            Node* n = fine[i];
+            n->worldPosition = w.x * n1->worldPosition + w.y * n2->worldPosition + w.z * n3->worldPosition;
+            n->lastWorldPosition = w.x * n1->lastWorldPosition + w.y * n2->lastWorldPosition + w.z * n3->lastWorldPosition;
+            n->velocity = w.x * n1->velocity + w.y * n2->velocity + w.z * n3->velocity;
+            n->force = glm::vec3(0);
+        }
+    }
+
+private:
+    /*
+     * locate every fine node in the coarse triangulation
+     * both levels share the panel contour, so every fine node lies in some coarse triangle;
+     * coarse triangles are bucketed on a grid of the coarse step to keep the search local
+     */
+    static LevelMapping buildMapping(Cloth* coarse, Cloth* fine)
+    {
+        glm::vec2 lo(FLT_MAX), hi(-FLT_MAX);
+        for (Node* n : coarse->nodes) {
+            lo = glm::min(lo, glm::vec2(n->localPosition));
+            hi = glm::max(hi, glm::vec2(n->localPosition));
+        }
+        const float cell = coarse->step > 0.0f ? coarse->step : std::max(hi.x - lo.x, hi.y - lo.y);
+        const int cols = std::max(1, int((hi.x - lo.x) / cell) + 1);
+        const int rows = std::max(1, int((hi.y - lo.y) / cell) + 1);
+        auto cellOf = [&](const glm::vec2& p) {
+            int x = glm::clamp(int((p.x - lo.x) / cell), 0, cols - 1);
+            int y = glm::clamp(int((p.y - lo.y) / cell), 0, rows - 1);
+            return glm::ivec2(x, y);
+        };
+
+        // bucket triangles by the cells their bounding box overlaps
+        const size_t tri_sz = coarse->faces.size() / 3;
+        std::vector<std::vector<int>> buckets(size_t(cols) * rows);
+        for (size_t t = 0; t < tri_sz; t++) {
+            glm::vec2 a = coarse->faces[3 * t]->localPosition;
+            glm::vec2 b = coarse->faces[3 * t + 1]->localPosition;
+            glm::vec2 c = coarse->faces[3 * t + 2]->localPosition;
+            glm::ivec2 c0 = cellOf(glm::min(a, glm::min(b, c)));
+            glm::ivec2 c1 = cellOf(glm::max(a, glm::max(b, c)));
+            for (int y = c0.y; y <= c1.y; y++) {
+                for (int x = c0.x; x <= c1.x; x++) {
+                    buckets[size_t(y) * cols + x].push_back(int(t));
+                }
+            }
+        }
+
+        LevelMapping mapping;
+        mapping.nodes.reserve(fine->nodes.size());
+        mapping.weights.reserve(fine->nodes.size());
+        for (Node* n : fine->nodes) {
+            glm::vec2 p = n->localPosition;
+            glm::ivec2 c = cellOf(p);
+
+            // pick the triangle whose smallest barycentric weight is largest; for a point inside it is >= 0
+            int best = -1;
+            glm::vec3 bestWeights(0.0f);
+            float bestScore = -FLT_MAX;
+            auto test = [&](int t) {
+                glm::vec3 w = barycentric(p, coarse->faces[3 * t]->localPosition,
+                    coarse->faces[3 * t + 1]->localPosition, coarse->faces[3 * t + 2]->localPosition);
+                float score = std::min(w.x, std::min(w.y, w.z));
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestWeights = w;
+                    best = t;
+                }
+            };
+            for (int t : buckets[size_t(c.y) * cols + c.x]) {
+                test(t);
+            }
+            if (best == -1) {
+                for (size_t t = 0; t < tri_sz; t++) {
+                    test(int(t));
+                }
+            }
+            assert(best != -1);
+
+            // points slightly outside (round-off on the contour) are clamped back onto the triangle
+            bestWeights = glm::max(bestWeights, glm::vec3(0.0f));
+            bestWeights /= bestWeights.x + bestWeights.y + bestWeights.z;
+            mapping.nodes.push_back(glm::ivec3(
+                coarse->faces[3 * best]->localID,
+                coarse->faces[3 * best + 1]->localID,
+                coarse->faces[3 * best + 2]->localID));
+            mapping.weights.push_back(bestWeights);
+        }
+        return mapping;
+    }
+
+    static glm::vec3 barycentric(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b, const glm::vec2& c)
+    {
+        glm::vec2 v0 = b - a, v1 = c - a, v2 = p - a;
+        float den = v0.x * v1.y - v1.x * v0.y;
+        if (fabs(den) < 1e-12f) {
+            return glm::vec3(-FLT_MAX);
+        }
+        float v = (v2.x * v1.y - v1.x * v2.y) / den;
+        float w = (v0.x * v2.y - v2.x * v0.y) / den;
+        return glm::vec3(1.0f - v - w, v, w);
+    }
+};
+
+#endif
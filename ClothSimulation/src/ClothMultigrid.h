@@ -0,0 +1,364 @@
+#ifndef CLOTH_MULTIGRID_H
+#define CLOTH_MULTIGRID_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include "ClothHierarchy.h"
+
+// Default Solver Values
+const int MG_MAX_ITERATIONS = 30;
+const float MG_TOLERANCE = 1e-4f;
+const int MG_SMOOTH_STEPS = 2;
+const int MG_COARSE_STEPS = 20;
+
+/*
+ * symmetric sparse matrix in CSR form
+ * entries are scalars shared by the x, y and z components, so it multiplies vectors of glm::vec3
+ */
+struct SparseMatrix
+{
+    std::vector<int> rowStart;
+    std::vector<int> cols;
+    std::vector<float> values;
+    std::vector<float> diagonal;
+
+    size_t size() const { return diagonal.size(); }
+
+    /*
+     * build from (row, col, value) triplets; duplicated entries are summed
+     */
+    void assign(size_t n, std::vector<std::pair<uint64_t, float>>& triplets)
+    {
+        std::sort(triplets.begin(), triplets.end(),
+            [](const std::pair<uint64_t, float>& a, const std::pair<uint64_t, float>& b) { return a.first < b.first; });
+
+        rowStart.assign(n + 1, 0);
+        cols.clear();
+        values.clear();
+        diagonal.assign(n, 0.0f);
+        for (size_t k = 0, sz = triplets.size(); k < sz;) {
+            uint64_t key = triplets[k].first;
+            float v = 0.0f;
+            for (; k < sz && triplets[k].first == key; k++) {
+                v += triplets[k].second;
+            }
+            int row = int(key >> 32);
+            int col = int(key & 0xffffffffu);
+            cols.push_back(col);
+            values.push_back(v);
+            rowStart[row + 1] += 1;
+            if (row == col) {
+                diagonal[row] = v;
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            rowStart[i + 1] += rowStart[i];
+        }
+    }
+
+    void multiply(const std::vector<glm::vec3>& x, std::vector<glm::vec3>& y) const
+    {
+        for (size_t i = 0, n = size(); i < n; i++) {
+            glm::vec3 sum(0.0f);
+            for (int k = rowStart[i]; k < rowStart[i + 1]; k++) {
+                sum += values[k] * x[cols[k]];
+            }
+            y[i] = sum;
+        }
+    }
+
+    /*
+     * one Gauss-Seidel sweep, forward or backward
+     * a forward pre-smooth with a backward post-smooth keeps the V-cycle symmetric, as PCG requires
+     */
+    void gaussSeidel(const std::vector<glm::vec3>& b, std::vector<glm::vec3>& x, bool forward) const
+    {
+        const int n = int(size());
+        for (int c = 0; c < n; c++) {
+            const int i = forward ? c : n - 1 - c;
+            glm::vec3 sum = b[i];
+            for (int k = rowStart[i]; k < rowStart[i + 1]; k++) {
+                if (cols[k] != i) {
+                    sum -= values[k] * x[cols[k]];
+                }
+            }
+            x[i] = sum / diagonal[i];
+        }
+    }
+};
+
+static inline uint64_t matrixKey(int row, int col)
+{
+    return (uint64_t(uint32_t(row)) << 32) | uint32_t(col);
+}
+
+/*
+ * linearly implicit (backward Euler) integration of a cloth hierarchy's finest level,
+ * solved by conjugate gradient with a multigrid V-cycle as preconditioner
+ *
+ * The spring Jacobian is approximated by the weighted graph Laplacian of the springs
+ * (Desbrun et al. 1999), giving one scalar SPD system shared by x, y and z:
+ *     (M + h * L_damp + h^2 * L_stiff) dv = h * (f - h * L_stiff * v)
+ * Coarse operators are Galerkin products P^T A P over the barycentric prolongations of the hierarchy,
+ * so smooth, low-frequency error is removed on the coarse meshes instead of spreading one ring per sweep.
+ */
+class MultigridSolver : public ClothSolver
+{
+public:
+    int maxIterations = MG_MAX_ITERATIONS;
+    float tolerance = MG_TOLERANCE;     // relative residual at which PCG stops
+    int smoothSteps = MG_SMOOTH_STEPS;  // Gauss-Seidel sweeps before and after each coarse correction
+    int coarseSteps = MG_COARSE_STEPS;  // symmetric sweeps on the coarsest level
+    int lastIterations = 0;             // statistics of the last solve
+    float lastResidual = 0.0f;
+
+    MultigridSolver(ClothHierarchy* clothHierarchy)
+    {
+        hierarchy = clothHierarchy;
+        builtTimeStep = -1.0f;
+        builtRevision = 0;
+    }
+
+    /*
+     * Node::force already holds the spring forces of this step
+     */
+    void integrate(Cloth* cloth, float timeStep) override
+    {
+        assert(cloth == hierarchy->finest());
+        prepare(timeStep);
+
+        const std::vector<Node*>& nodes = cloth->nodes;
+        const size_t n = nodes.size();
+        std::vector<glm::vec3>& v = velocity;
+        std::vector<glm::vec3>& b = rhs;
+        v.resize(n);
+        b.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            v[i] = nodes[i]->velocity;
+        }
+        stiffness.multiply(v, b);
+        for (size_t i = 0; i < n; i++) {
+            b[i] = timeStep * (nodes[i]->force - timeStep * b[i]);
+        }
+
+        std::vector<glm::vec3>& dv = solution;
+        dv.assign(n, glm::vec3(0.0f));
+        solve(b, dv);
+
+        for (size_t i = 0; i < n; i++) {
+            Node* node = nodes[i];
+            node->acceleration = dv[i] / timeStep;
+            node->velocity += dv[i];
+            node->lastWorldPosition = node->worldPosition;
+            node->worldPosition += node->velocity * timeStep;
+            node->force = glm::vec3(0);
+        }
+    }
+
+    /*
+     * (re)build the operators if the time step changed or the finest cloth got new springs, coefficients or masses
+     */
+    void prepare(float timeStep)
+    {
+        if (timeStep != builtTimeStep || hierarchy->finest()->revision != builtRevision || matrices.empty()) {
+            buildOperators(timeStep);
+        }
+    }
+
+    /*
+     * preconditioned conjugate gradient on the operators of the last prepare(),
+     * the three components are independent systems with the same matrix
+     */
+    void solve(const std::vector<glm::vec3>& b, std::vector<glm::vec3>& x)
+    {
+        const SparseMatrix& A = matrices.back();
+        const size_t n = A.size();
+        const size_t finest = matrices.size() - 1;
+        residual = b;
+        direction.resize(n);
+        preconditioned.resize(n);
+        product.resize(n);
+
+        glm::vec3 bNorm = dot(b, b);
+        vCycle(finest, residual, preconditioned);
+        direction = preconditioned;
+        glm::vec3 rz = dot(residual, preconditioned);
+
+        lastIterations = 0;
+        lastResidual = 0.0f;
+        for (int it = 0; it < maxIterations; it++) {
+            A.multiply(direction, product);
+            glm::vec3 alpha = safeDivide(rz, dot(direction, product));
+            for (size_t i = 0; i < n; i++) {
+                x[i] += alpha * direction[i];
+                residual[i] -= alpha * product[i];
+            }
+            lastIterations = it + 1;
+
+            glm::vec3 rNorm = dot(residual, residual);
+            lastResidual = sqrt(std::max(rNorm.x / std::max(bNorm.x, FLT_MIN),
+                std::max(rNorm.y / std::max(bNorm.y, FLT_MIN), rNorm.z / std::max(bNorm.z, FLT_MIN))));
+            if (lastResidual < tolerance) {
+                break;
+            }
+
+            vCycle(finest, residual, preconditioned);
+            glm::vec3 rzNew = dot(residual, preconditioned);
+            glm::vec3 beta = safeDivide(rzNew, rz);
+            rz = rzNew;
+            for (size_t i = 0; i < n; i++) {
+                direction[i] = preconditioned[i] + beta * direction[i];
+            }
+        }
+    }
+
+private:
+    ClothHierarchy* hierarchy;
+    float builtTimeStep;
+    uint32_t builtRevision;             // Cloth::revision of the finest level the operators were built for
+    SparseMatrix stiffness;             // L_stiff of the finest level, for the right hand side
+    std::vector<SparseMatrix> matrices; // system matrix of every level, matrices.back() is the finest
+    std::vector<glm::vec3> velocity, rhs, solution;
+    std::vector<glm::vec3> residual, direction, preconditioned, product;
+    std::vector<std::vector<glm::vec3>> levelX, levelB, levelR;
+
+    void buildOperators(float timeStep)
+    {
+        builtTimeStep = timeStep;
+        builtRevision = hierarchy->finest()->revision;
+        const size_t levelCount = hierarchy->levels.size();
+        matrices.assign(levelCount, SparseMatrix());
+
+        // finest level: masses on the diagonal plus one Laplacian stencil per spring
+        Cloth* finest = hierarchy->finest();
+        const size_t n = finest->nodes.size();
+        std::vector<std::pair<uint64_t, float>> triplets, stiffTriplets;
+        triplets.reserve(n + finest->springs.size() * 4);
+        stiffTriplets.reserve(finest->springs.size() * 4);
+        for (Node* node : finest->nodes) {
+            triplets.push_back({ matrixKey(node->localID, node->localID), node->mass });
+        }
+        for (Spring* s : finest->springs) {
+            int i = s->node1->localID;
+            int j = s->node2->localID;
+            float c = timeStep * s->dampCoef + timeStep * timeStep * s->hookCoef;
+            addStencil(triplets, i, j, c);
+            addStencil(stiffTriplets, i, j, s->hookCoef);
+        }
+        matrices.back().assign(n, triplets);
+        stiffness.assign(n, stiffTriplets);
+
+        // coarser levels: Galerkin product P^T A P
+        for (size_t l = levelCount - 1; l > 0; l--) {
+            const SparseMatrix& fine = matrices[l];
+            const LevelMapping& mapping = hierarchy->prolongations[l - 1];
+            triplets.clear();
+            triplets.reserve(fine.values.size() * 9);
+            for (size_t i = 0, fine_sz = fine.size(); i < fine_sz; i++) {
+                const glm::ivec3& ti = mapping.nodes[i];
+                const glm::vec3& wi = mapping.weights[i];
+                for (int k = fine.rowStart[i]; k < fine.rowStart[i + 1]; k++) {
+                    const int j = fine.cols[k];
+                    const glm::ivec3& tj = mapping.nodes[j];
+                    const glm::vec3& wj = mapping.weights[j];
+                    for (int a = 0; a < 3; a++) {
+                        if (wi[a] == 0.0f) continue;
+                        for (int c = 0; c < 3; c++) {
+                            if (wj[c] == 0.0f) continue;
+                            triplets.push_back({ matrixKey(ti[a], tj[c]), wi[a] * fine.values[k] * wj[c] });
+                        }
+                    }
+                }
+            }
+            matrices[l - 1].assign(hierarchy->levels[l - 1]->nodes.size(), triplets);
+        }
+
+        levelX.assign(levelCount, std::vector<glm::vec3>());
+        levelB.assign(levelCount, std::vector<glm::vec3>());
+        levelR.assign(levelCount, std::vector<glm::vec3>());
+        for (size_t l = 0; l < levelCount; l++) {
+            size_t sz = matrices[l].size();
+            levelX[l].resize(sz);
+            levelB[l].resize(sz);
+            levelR[l].resize(sz);
+        }
+    }
+
+    static void addStencil(std::vector<std::pair<uint64_t, float>>& triplets, int i, int j, float c)
+    {
+        triplets.push_back({ matrixKey(i, i), c });
+        triplets.push_back({ matrixKey(j, j), c });
+        triplets.push_back({ matrixKey(i, j), -c });
+        triplets.push_back({ matrixKey(j, i), -c });
+    }
+
+    /*
+     * x = V-cycle(b) with zero initial guess on 'level'
+     */
+    void vCycle(size_t level, const std::vector<glm::vec3>& b, std::vector<glm::vec3>& x)
+    {
+        const SparseMatrix& A = matrices[level];
+        std::fill(x.begin(), x.end(), glm::vec3(0.0f));
+        if (level == 0) {
+            for (int s = 0; s < coarseSteps; s++) {
+                A.gaussSeidel(b, x, true);
+                A.gaussSeidel(b, x, false);
+            }
+            return;
+        }
+
+        for (int s = 0; s < smoothSteps; s++) {
+            A.gaussSeidel(b, x, true);
+        }
+
+        // restrict the residual: r_c = P^T (b - A x)
+        std::vector<glm::vec3>& r = levelR[level];
+        A.multiply(x, r);
+        std::vector<glm::vec3>& bc = levelB[level - 1];
+        std::fill(bc.begin(), bc.end(), glm::vec3(0.0f));
+        const LevelMapping& mapping = hierarchy->prolongations[level - 1];
+        for (size_t i = 0, sz = r.size(); i < sz; i++) {
+            glm::vec3 ri = b[i] - r[i];
+            const glm::ivec3& t = mapping.nodes[i];
+            const glm::vec3& w = mapping.weights[i];
+            bc[t.x] += w.x * ri;
+            bc[t.y] += w.y * ri;
+            bc[t.z] += w.z * ri;
+        }
+
+        std::vector<glm::vec3>& xc = levelX[level - 1];
+        vCycle(level - 1, bc, xc);
+
+        // prolongate the correction: x += P x_c
+        for (size_t i = 0, sz = x.size(); i < sz; i++) {
+            const glm::ivec3& t = mapping.nodes[i];
+            const glm::vec3& w = mapping.weights[i];
+            x[i] += w.x * xc[t.x] + w.y * xc[t.y] + w.z * xc[t.z];
+        }
+
+        for (int s = 0; s < smoothSteps; s++) {
+            A.gaussSeidel(b, x, false);
+        }
+    }
+
+    static glm::vec3 dot(const std::vector<glm::vec3>& a, const std::vector<glm::vec3>& b)
+    {
+        glm::vec3 sum(0.0f);
+        for (size_t i = 0, n = a.size(); i < n; i++) {
+            sum += a[i] * b[i];
+        }
+        return sum;
+    }
+
+    static glm::vec3 safeDivide(const glm::vec3& a, const glm::vec3& b)
+    {
+        return glm::vec3(
+            b.x != 0.0f ? a.x / b.x : 0.0f,
+            b.y != 0.0f ? a.y / b.y : 0.0f,
+            b.z != 0.0f ? a.z / b.z : 0.0f);
+    }
+};
+
+#endif
@@ -1,8 +1,30 @@
 #ifndef CLOTH_PICKER_H
 #define CLOTH_PICKER_H
 
+#include <map>
+
 #include "Cloth.h"
 #include "Camera.h"
+#include "ClothBVH.h"
+#include "SeamSpec.h"
+
+// Defaults
+const float PICK_RADIUS = 0.2f;             // farthest a hit may be from the contour to pick a segment
+const float SEAM_SEARCH_RADIUS = 3.0f;      // farthest a partner segment may be from a segment, in world space
+const int SEAM_SAMPLES = 8;                 // points along a segment that look for their nearest partner
+
+/*
+ * a segment that is likely sewed to another one; lower scores are better
+ */
+struct SeamSuggestion
+{
+    Cloth* cloth;
+    int segment;
+    Cloth* partner;
+    int partnerSegment;
+    bool reversed;      // the partner runs the other way
+    float score;        // mean distance relative to SEAM_SEARCH_RADIUS plus the relative difference in length
+};
 
 class ClothPicker
 {
@@ -14,57 +36,29 @@ public:
 
     /*
      * check whether ray intersect with cloths
-     * return the cloth with the greatest z
+     * return the cloth whose triangle is hit closest to the camera
      */
     Cloth* pickCloth(const std::vector<Cloth*>& cloths, const glm::vec3& ray)
     {
         Cloth* selectedCloth = nullptr;
-        float distance; // distance between camera and hitpoint
-        glm::vec3 hitPoint;
+        RayHit hit;
 
         for (Cloth* cloth : cloths)
         {
-            // corners of bounding box
-            glm::vec3 pointLeftUpper = cloth->leftUpper;
-            glm::vec3 pointRightUpper = cloth->rightUpper;
-            glm::vec3 pointRightBottom = cloth->rightBottom;
-
-            // Intersection Point of a Line and a Plane
-            // -------------------------
-            // normal vector of the cloth
-            glm::vec3 normal = glm::cross(pointRightBottom - pointLeftUpper, pointRightUpper - pointLeftUpper);
-            // hitPoint = camera.Position + ray * t
-            double t = glm::dot(pointLeftUpper - camera->Position, normal) / glm::dot(ray, normal);
-            // intersection point
-            glm::vec3 hit = camera->Position + glm::vec3(ray.x * t, ray.y * t, ray.z * t);
-            if (hit.x >= pointLeftUpper.x && hit.x <= pointRightUpper.x && hit.y <= pointLeftUpper.y && hit.y >= pointRightBottom.y)
-            {
-                float d = glm::length(hit - camera->Position);
-                // when cloths are overlapping, select cloth closest to camera
-                if (selectedCloth == nullptr || (selectedCloth != nullptr && d < distance)) {
-                    selectedCloth = cloth;
-                    distance = d;
-                    hitPoint = hit;
-                }
+            // when cloths are overlapping, select cloth closest to camera
+            if (bvhOf(cloth).intersect(camera->Position, ray, hit)) {
+                selectedCloth = cloth;
             }
         }
         if (selectedCloth != nullptr) {
             std::cout << "Cloth " << selectedCloth->GetClothID() << " Selected\n";
 
-            // find the point 'P' that is closest to the hitpoint on the contour
-            // according to P.segmentID, we select all points in that segment
+            // find the point 'P' on the contour that is closest to the hitpoint
+            // we select all points in the segment of P
             // ---------------------------------------
-            distance = FLT_MAX;
-            Node* nearPoint = nullptr;
-            for (Node* n : selectedCloth->contour) {
-                float d = glm::distance(hitPoint, n->worldPosition);
-                if (d < distance && d < 0.2f) {
-                    distance = d;
-                    nearPoint = n;
-                }
-            }
-            if (nearPoint && !nearPoint->isSelected) {
-                int segmentId = nearPoint->segmentID;
+            ContourHit contour;
+            if (bvhs[selectedCloth].nearestContour(hit.point, PICK_RADIUS, contour) && !contour.node->isSelected) {
+                int segmentId = contour.segment;
                 std::vector<Node*> segment;
                 for (Node* n : selectedCloth->segments[segmentId]) {
                     // Potential Bug
@@ -74,13 +68,130 @@ public:
                     n->isSelected = true;
                 }
                 selectedCloth->sewNode.push_back(segment);
+
+                std::vector<SeamSuggestion> partners = suggestPartners(cloths, selectedCloth, segmentId, 1);
+                if (!partners.empty()) {
+                    std::cout << "Likely partner: cloth " << partners[0].partner->GetClothID() << " segment " << partners[0].partnerSegment
+                        << (partners[0].reversed ? " (reversed)\n" : "\n");
+                }
             }
 
         }
         return selectedCloth;
     }
+
+    /*
+     * segments of the other cloths that lie along 'segment' and have about its length
+     * segments of the same cloth are left out, its neighbours would always be closest at their common corner
+     * a candidate has to be the nearest contour to at least half of the samples of 'segment'; best first, at most 'count'
+     */
+    std::vector<SeamSuggestion> suggestPartners(const std::vector<Cloth*>& cloths, Cloth* cloth, int segment, size_t count)
+    {
+        std::vector<SeamSuggestion> suggestions;
+        const std::vector<Node*>& nodes = cloth->segments[segment];
+        if (nodes.size() < 2) {
+            return suggestions;
+        }
+        std::vector<glm::vec3> samples;
+        for (int i = 0; i < SEAM_SAMPLES; i++) {
+            float u = float(i) / float(SEAM_SAMPLES - 1) * float(nodes.size() - 1);
+            size_t k = std::min(size_t(u), nodes.size() - 2);
+            samples.push_back(glm::mix(nodes[k]->worldPosition, nodes[k + 1]->worldPosition, u - float(k)));
+        }
+        const float length = patternLength(nodes);
+
+        for (Cloth* other : cloths) {
+            if (other == cloth) {
+                continue;
+            }
+            ClothBVH& bvh = bvhOf(other);
+            std::map<int, std::pair<int, float>> votes;     // segment -> samples, sum of distances
+            for (const glm::vec3& p : samples) {
+                ContourHit contour;
+                if (bvh.nearestContour(p, SEAM_SEARCH_RADIUS, contour)) {
+                    votes[contour.segment].first++;
+                    votes[contour.segment].second += contour.distance;
+                }
+            }
+            for (const auto& vote : votes) {
+                if (2 * vote.second.first < SEAM_SAMPLES) {
+                    continue;
+                }
+                const std::vector<Node*>& partner = other->segments[vote.first];
+                const float partnerLength = patternLength(partner);
+                SeamSuggestion s;
+                s.cloth = cloth;
+                s.segment = segment;
+                s.partner = other;
+                s.partnerSegment = vote.first;
+                s.reversed = glm::distance(nodes.front()->worldPosition, partner.back()->worldPosition) + glm::distance(nodes.back()->worldPosition, partner.front()->worldPosition)
+                    < glm::distance(nodes.front()->worldPosition, partner.front()->worldPosition) + glm::distance(nodes.back()->worldPosition, partner.back()->worldPosition);
+                s.score = vote.second.second / vote.second.first / SEAM_SEARCH_RADIUS
+                    + fabs(length - partnerLength) / std::max(std::max(length, partnerLength), FLT_MIN);
+                suggestions.push_back(s);
+            }
+        }
+        std::sort(suggestions.begin(), suggestions.end(), [](const SeamSuggestion& a, const SeamSuggestion& b) { return a.score < b.score; });
+        if (suggestions.size() > count) {
+            suggestions.resize(count);
+        }
+        return suggestions;
+    }
+
+    /*
+     * a seam for every pair of segments that suggest each other first, panels numbered by their index in 'cloths'
+     */
+    SeamSpec suggestSeams(const std::vector<Cloth*>& cloths)
+    {
+        std::map<Cloth*, int> panel;
+        for (int i = 0; i < int(cloths.size()); i++) {
+            panel[cloths[i]] = i;
+        }
+        std::map<std::pair<int, int>, SeamSuggestion> best;    // (panel, segment) -> its best partner
+        for (Cloth* cloth : cloths) {
+            for (int s = 0; s < int(cloth->segments.size()); s++) {
+                std::vector<SeamSuggestion> partners = suggestPartners(cloths, cloth, s, 1);
+                if (!partners.empty()) {
+                    best[{ panel[cloth], s }] = partners[0];
+                }
+            }
+        }
+        SeamSpec spec;
+        for (const auto& entry : best) {
+            const SeamSuggestion& s = entry.second;
+            const std::pair<int, int> partner(panel[s.partner], s.partnerSegment);
+            auto back = best.find(partner);
+            if (back != best.end() && back->second.partner == s.cloth && back->second.partnerSegment == s.segment && entry.first < partner) {
+                spec.seams.push_back(SeamEntry{ entry.first.first, s.segment, partner.first, s.partnerSegment, s.reversed });
+            }
+        }
+        return spec;
+    }
+
 private:
     Camera* camera;
+    std::map<const Cloth*, ClothBVH> bvhs;   // built on first use, refitted on every query since cloths move
+
+    ClothBVH& bvhOf(const Cloth* cloth)
+    {
+        ClothBVH& bvh = bvhs[cloth];
+        if (!bvh.isBuiltFor(cloth)) {
+            bvh.build(cloth);
+        }
+        else {
+            bvh.refit();
+        }
+        return bvh;
+    }
+
+    static float patternLength(const std::vector<Node*>& nodes)
+    {
+        float length = 0.0f;
+        for (size_t i = 1; i < nodes.size(); i++) {
+            length += glm::distance(nodes[i - 1]->localPosition, nodes[i]->localPosition);
+        }
+        return length;
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
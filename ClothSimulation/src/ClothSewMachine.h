@@ -1,7 +1,50 @@
 #ifndef CLOTH_SEWMACHINE_H
 #define CLOTH_SEWMACHINE_H
 #include <assert.h>
+#include <algorithm>
 #include "Cloth.h"
+#include "SeamSpec.h"
+
+/*
+ * one end of a stitch: a node, or a point on the contour between two neighbouring nodes (b != nullptr)
+ * forces on a point between nodes are split between them by the interpolation weight
+ */
+struct SeamPoint
+{
+    Node* a;
+    Node* b;
+    float t;
+
+    glm::vec3 position() const { return b ? glm::mix(a->worldPosition, b->worldPosition, t) : a->worldPosition; }
+    glm::vec3 velocity() const { return b ? glm::mix(a->velocity, b->velocity, t) : a->velocity; }
+
+    void addForce(const glm::vec3& force) const
+    {
+        if (b) {
+            a->addForce(force * (1.0f - t));
+            b->addForce(force * t);
+        }
+        else {
+            a->addForce(force);
+        }
+    }
+};
+
+struct Stitch
+{
+    SeamPoint p1;   // on cloth1
+    SeamPoint p2;   // on cloth2
+};
+
+/*
+ * sewed stitches between two cloths
+ */
+struct Seam
+{
+    Cloth* cloth1;
+    Cloth* cloth2;
+    std::vector<Stitch> stitches;
+};
 
 class ClothSewMachine
 {
@@ -14,10 +57,11 @@ public:
     GLuint VBO;
     Shader shader;
 
-    std::vector<Node*> vertices;        // nodes to be sewed
-    std::vector<glm::vec3> positions;   // position of vertices for drawing sewing lines
-    std::vector<Spring*> springs;		// springs between nodes to be sewed
+    std::vector<Seam> seams;            // every seam that has been sewed, by hand or from a spec
+    std::vector<Stitch> stitches;       // of the picked pair, matched once per pair of segments, in the order the segments were picked
+    std::vector<glm::vec3> positions;   // ends of the stitches for drawing sewing lines
     const float sewCoef = 1500.0f;
+    const float sewDamping = 2.0f;
     const float threshold = 0.05f;
     bool resetable;	    // after reset(), VAO VBO will be deleted
                         // therefore 'resetable' is used to decide whether we can reset()
@@ -27,44 +71,75 @@ public:
         cloth1 = cloth2 = nullptr;
         camera = cam;
         resetable = false;
+        matchedSegments = 0;
     }
 
     ~ClothSewMachine()
     {
+        deleteBuffers();
+    }
+
+    /*
+     * GL objects of the sewing line; call before the context is destroyed, picking two cloths creates them again
+     */
+    void deleteBuffers()
+    {
+        // VAO VBO can only be deleted once
         if (resetable)
         {
             glDeleteVertexArrays(1, &VAO);
             glDeleteBuffers(1, &VBO);
             glDeleteProgram(shader.ID);
-            for (Spring* s : springs) {
-                delete s;
+        }
+        resetable = false;
+    }
+
+    /*
+     * add the forces of the seams to their nodes; called between the cloths' computeForces() and integrate(),
+     * so every node is still integrated once per step, whichever seams it belongs to
+     * pairs that are closer than 'threshold' are held together by constrain() instead
+     */
+    void addForces()
+    {
+        // a spring of rest length 0 between the ends, as Spring::computeInternalForce
+        for (const Seam& seam : seams) {
+            for (const Stitch& s : seam.stitches) {
+                const glm::vec3 delta = s.p2.position() - s.p1.position();
+                const float length = glm::length(delta);
+                if (length < threshold) {
+                    continue;
+                }
+                const glm::vec3 direction = delta / length;
+                const glm::vec3 force = direction * (length * sewCoef + glm::dot(s.p2.velocity() - s.p1.velocity(), direction) * sewDamping);
+                s.p1.addForce(force);
+                s.p2.addForce(-force);
             }
-            springs.clear();
         }
     }
 
-    void update(float timeStep)
+    /*
+     * after integration: move node pairs closer than 'threshold' to their middle point and give them a common velocity
+     * stitches ending between nodes are only pulled by addForces()
+     */
+    void constrain()
     {
-        Node* n1 = nullptr;
-        Node* n2 = nullptr;
-        // update springs between nodes to be sewed
-        for (Spring* s : springs) {
-            n1 = s->node1;
-            n2 = s->node2;
-            // upgrade: now we just simply move nodes to middle point
-            if (glm::distance(n1->worldPosition, n2->worldPosition) < threshold) {
-                glm::vec3 newPos = (n1->worldPosition + n2->worldPosition) / 2.0f;
-                n1->worldPosition = n2->worldPosition = newPos;
-                continue;
+        for (const Seam& seam : seams) {
+            for (const Stitch& s : seam.stitches) {
+                if (s.p1.b || s.p2.b) {
+                    continue;
+                }
+                Node* n1 = s.p1.a;
+                Node* n2 = s.p2.a;
+                if (glm::distance(n1->worldPosition, n2->worldPosition) < threshold) {
+                    n1->worldPosition = n2->worldPosition = (n1->worldPosition + n2->worldPosition) / 2.0f;
+                    n1->velocity = n2->velocity = (n1->velocity + n2->velocity) / 2.0f;
+                }
             }
-            s->computeInternalForce(timeStep);
-            n1->integrate(timeStep);
-            n2->integrate(timeStep);
         }
     }
 
     /*
-     * Sew Cloth in Heuristic method: we add springs between nodes, therefore springs can drag them together
+     * Sew Cloth in Heuristic method: stitches act as springs, therefore they can drag the cloths together
      */
     void SewCloths()
     {
@@ -72,18 +147,50 @@ public:
         if (cloth1 == nullptr || cloth2 == nullptr || cloth1->isSewed || cloth2->isSewed) {
             return;
         }
-        
-        Node* n1, * n2;
-        for (int i = 0; i < vertices.size(); i += 2) {
-            n1 = vertices[i];
-            n2 = vertices[i + 1];
-            n1->isSewed = n2->isSewed = true;
-            // Heuristic method
-            Spring* s = new Spring(n1, n2, sewCoef);
-            s->restLength = 0.0f;	// small rest length to make cloths closer
-            springs.push_back(s);
+
+        matchSegments();
+        seams.push_back(Seam{ cloth1, cloth2, std::move(stitches) });
+        clearStitches();
+        markSewed(seams.back());
+    }
+
+    /*
+     * sew two segments right away, without picking them; a cloth may take part in any number of seams
+     * returns false if a cloth or segment does not exist
+     */
+    bool sew(Cloth* c1, size_t segment1, Cloth* c2, size_t segment2, bool reversed)
+    {
+        if (c1 == nullptr || c2 == nullptr || segment1 >= c1->segments.size() || segment2 >= c2->segments.size()) {
+            return false;
+        }
+        std::vector<Node*> nodes2 = c2->segments[segment2];
+        if (reversed) {
+            std::reverse(nodes2.begin(), nodes2.end());
         }
-        cloth1->isSewed = cloth2->isSewed = true;
+        Seam seam{ c1, c2, {} };
+        matchByArcLength(c1->segments[segment1], nodes2, seam.stitches);
+        seams.push_back(std::move(seam));
+        markSewed(seams.back());
+        return true;
+    }
+
+    /*
+     * sew every seam of a spec; panels are indices into 'cloths'
+     * returns the number of seams sewed, seams naming a missing panel or segment are reported and skipped
+     */
+    size_t sew(const SeamSpec& spec, const std::vector<Cloth*>& cloths)
+    {
+        size_t sewed = 0;
+        for (const SeamEntry& e : spec.seams) {
+            Cloth* c1 = size_t(e.panel) < cloths.size() ? cloths[e.panel] : nullptr;
+            Cloth* c2 = size_t(e.partner) < cloths.size() ? cloths[e.partner] : nullptr;
+            if ((c1 == c2 && e.segment == e.partnerSegment) || !sew(c1, e.segment, c2, e.partnerSegment, e.reversed)) {
+                std::cout << "[SewMachine] seam " << e.panel << ":" << e.segment << " - " << e.partner << ":" << e.partnerSegment << " skipped" << std::endl;
+                continue;
+            }
+            sewed++;
+        }
+        return sewed;
     }
 
     void drawSewingLine(const glm::mat4& view, const glm::mat4& projection)
@@ -91,8 +198,8 @@ public:
         if (cloth1 == nullptr || cloth2 == nullptr || cloth1->isSewed || cloth2->isSewed) {
             return;
         }
-        // position of nodes may be updated, so we need to set them
-        setSewNode();
+        // cloths may have been moved; stitches of newly picked segments are matched by setCandidateCloth
+        updatePositions();
 
         shader.use();
         glBindVertexArray(VAO);
@@ -124,11 +231,17 @@ public:
         else if (cloth1 != cloth && cloth2 == nullptr)
         {
             cloth2 = cloth;
+            clearStitches();
             initialization();
         }
         else if (cloth1 != cloth && cloth2 != cloth) {
             cloth1 = cloth;
             cloth2 = nullptr;
+            clearStitches();
+        }
+        // a segment may have been picked on one of the two cloths
+        if (cloth1 != nullptr && cloth2 != nullptr) {
+            matchSegments();
         }
     }
 
@@ -136,68 +249,139 @@ public:
     {
         if (cloth1) cloth1->reset();
         if (cloth2) cloth2->reset();
+        // seams of the reset cloths come undone
+        seams.erase(std::remove_if(seams.begin(), seams.end(), [this](const Seam& seam) {
+            return seam.cloth1 == cloth1 || seam.cloth2 == cloth1 || seam.cloth1 == cloth2 || seam.cloth2 == cloth2;
+        }), seams.end());
         cloth1 = cloth2 = nullptr;
 
-        // VAO VBO can only be deleted once
-        if (resetable)
-        {
-            glDeleteVertexArrays(1, &VAO);
-            glDeleteBuffers(1, &VBO);
-            glDeleteProgram(shader.ID);
-            for (Spring* s : springs) {
-                delete s;
-            }
-            springs.clear();
-        }
-        resetable = false;
+        deleteBuffers();
+        clearStitches();
     }
 
 
 private:
-    /* 
-     * every Cloth has a vector SewNode, which stores nodes to be sewed later
-     * sewNodes in two cloths should be matched
-     * we put data in sewNode into 'vertices', plus vertices[i] and vertices[i+1] will be sewed (i % 2 = 0)
-     */ 
-    void setSewNode() {
-        vertices.clear();
-        positions.clear();
+    size_t matchedSegments;     // pairs of picked segments that have stitches already
 
-        // retrieve data
+    /*
+     * every Cloth has a vector sewNode, the segments picked on it; the i-th segments of both cloths are sewed together
+     * a new pair is matched once, when both of its segments have been picked
+     */
+    void matchSegments()
+    {
         const std::vector<std::vector<Node*>>& sewNode1 = cloth1->sewNode;
         const std::vector<std::vector<Node*>>& sewNode2 = cloth2->sewNode;
+        for (size_t seg_sz = std::min(sewNode1.size(), sewNode2.size()); matchedSegments < seg_sz; matchedSegments++) {
+            matchByArcLength(sewNode1[matchedSegments], sewNode2[matchedSegments], stitches);
+        }
+    }
 
-        for (size_t i = 0, seg_sz = std::min(sewNode1.size(), sewNode2.size()); i < seg_sz; i++) {
-            const std::vector<Node*>& nodes1 = sewNode1[i];
-            const std::vector<Node*>& nodes2 = sewNode2[i];
-
-            int j = 0;
-            for (size_t cnt = 0, sz1 = nodes1.size(), sz2 = nodes2.size(), node_sz = std::min(sz1, sz2); cnt < node_sz; cnt++) {
-                Node* n1, * n2;
-                // number of nodes on contour may not be identical, we need to distribute them evenly
-                if (cnt % 2 == 0) {
-                    n1 = nodes1[j];
-                    n2 = nodes2[j];
-                }
-                else {
-                    n1 = nodes1[sz1 - 1 - j];
-                    n2 = nodes2[sz2 - 1 - j];
-                    j += 1;
+    /*
+     * stitches belong to one pair of cloths; whenever the pair changes or has been sewed, matching starts over
+     */
+    void clearStitches()
+    {
+        stitches.clear();
+        positions.clear();
+        matchedSegments = 0;
+    }
+
+    static void markSewed(const Seam& seam)
+    {
+        for (const Stitch& s : seam.stitches) {
+            for (const SeamPoint* p : { &s.p1, &s.p2 }) {
+                p->a->isSewed = true;
+                if (p->b) {
+                    p->b->isSewed = true;
                 }
-                vertices.push_back(n1);
-                vertices.push_back(n2);
-                positions.push_back(n1->worldPosition);
-                positions.push_back(n2->worldPosition);
             }
         }
+        seam.cloth1->isSewed = seam.cloth2->isSewed = true;
     }
 
-    void initialization()
+    void updatePositions()
     {
-        resetable = true;
+        positions.resize(stitches.size() * 2);
+        for (size_t i = 0; i < stitches.size(); i++) {
+            positions[2 * i] = stitches[i].p1.position();
+            positions[2 * i + 1] = stitches[i].p2.position();
+        }
+    }
+
+    /*
+     * position of every node along its segment, by arc length of the pattern, from 0 to 1
+     */
+    static std::vector<float> arcLengths(const std::vector<Node*>& nodes)
+    {
+        std::vector<float> s(nodes.size(), 0.0f);
+        for (size_t i = 1; i < nodes.size(); i++) {
+            s[i] = s[i - 1] + glm::distance(nodes[i - 1]->localPosition, nodes[i]->localPosition);
+        }
+        const float total = s.empty() ? 0.0f : s.back();
+        for (size_t i = 0; i < s.size(); i++) {
+            s[i] = total > 0.0f ? s[i] / total : (s.size() > 1 ? float(i) / float(s.size() - 1) : 0.0f);
+        }
+        return s;
+    }
 
+    /*
+     * the point at arc length 'u' of a segment
+     */
+    static SeamPoint pointAt(const std::vector<Node*>& nodes, const std::vector<float>& s, float u)
+    {
+        size_t k = std::upper_bound(s.begin(), s.end(), u) - s.begin();
+        if (k == 0) {
+            return SeamPoint{ nodes.front(), nullptr, 0.0f };
+        }
+        if (k == s.size()) {
+            return SeamPoint{ nodes.back(), nullptr, 0.0f };
+        }
+        const float t = (u - s[k - 1]) / (s[k] - s[k - 1]);
+        return SeamPoint{ nodes[k - 1], nodes[k], t };
+    }
+
+    /*
+     * every node of either segment is stitched to the point at the same relative arc length on the other one,
+     * so both sides close evenly however many nodes they have; points between nodes are virtual nodes
+     * nodes within a quarter of the denser spacing of each other are stitched directly
+     */
+    static void matchByArcLength(const std::vector<Node*>& nodes1, const std::vector<Node*>& nodes2, std::vector<Stitch>& out)
+    {
+        if (nodes1.empty() || nodes2.empty()) {
+            return;
+        }
+        const std::vector<float> s1 = arcLengths(nodes1);
+        const std::vector<float> s2 = arcLengths(nodes2);
+        const float snap = 0.25f / float(std::max<size_t>(std::max(nodes1.size(), nodes2.size()) - 1, 1));
+
+        size_t i = 0, j = 0;
+        while (i < nodes1.size() || j < nodes2.size()) {
+            if (i < nodes1.size() && j < nodes2.size() && fabs(s1[i] - s2[j]) <= snap) {
+                out.push_back(Stitch{ SeamPoint{ nodes1[i++], nullptr, 0.0f }, SeamPoint{ nodes2[j++], nullptr, 0.0f } });
+            }
+            else if (j == nodes2.size() || (i < nodes1.size() && s1[i] < s2[j])) {
+                out.push_back(Stitch{ SeamPoint{ nodes1[i], nullptr, 0.0f }, pointAt(nodes2, s2, s1[i]) });
+                i++;
+            }
+            else {
+                out.push_back(Stitch{ pointAt(nodes1, s1, s2[j]), SeamPoint{ nodes2[j], nullptr, 0.0f } });
+                j++;
+            }
+        }
+    }
+
+    void initialization()
+    {
         // set nodes to be sewed
-        setSewNode();
+        matchSegments();
+        updatePositions();
+
+        // the VAO, VBO and shader of an earlier pair are kept until reset()
+        if (resetable)
+        {
+            return;
+        }
+        resetable = true;
 
         shader = Shader("src/shaders/LineVS.glsl", "src/shaders/LineFS.glsl");
         std::cout << "Sew Program ID: " << shader.ID << std::endl;
@@ -212,7 +396,7 @@ private:
         // position buffer
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_DYNAMIC_DRAW);
 
         // enalbe attribute pointers
         glEnableVertexAttribArray(0);
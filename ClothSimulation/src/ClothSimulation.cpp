@@ -2,10 +2,13 @@
 #include <GLFW/glfw3.h>
 
 #include "Display.h"
+#include "PatternBatch.h"
+#include "SolverCheck.h"
 
 #include "ClothRender.h"
 #include "MeshRender.h"
 #include "ModelRender.h"
+#include "BodyLibrary.h"
 
 #define TIME_STEP 0.01
 
@@ -15,6 +18,7 @@ const int iterationFreq = 7;
 
 
 /** Functions **/
+bool renderScene();
 void processInput(GLFWwindow* window);
 
 /** Callback functions **/
@@ -39,6 +43,52 @@ bool right_bottom_down = false;
 
 int main(int argc, const char* argv[])
 {
+    /** Seams from a spec file instead of picking, materials of the panels, implicit integration with coarse levels:
+        ClothSimulation [--seams <file>] [--materials <file>] [--multigrid <levels>] **/
+    std::string seamFile, materialFile;
+    int multigridLevels = -1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::string(argv[i]) == "--seams") {
+            seamFile = argv[i + 1];
+        }
+        else if (std::string(argv[i]) == "--materials") {
+            materialFile = argv[i + 1];
+        }
+        else if (std::string(argv[i]) == "--multigrid") {
+            multigridLevels = atoi(argv[i + 1]);
+        }
+    }
+
+    /** Batch mesh cache: ClothSimulation --batch <folder or manifest> <cache folder> [step] **/
+    if (argc >= 4 && std::string(argv[1]) == "--batch") {
+        PatternBatch batch;
+        batch.cacheDir = argv[3];
+        if (argc >= 5) {
+            batch.meshStep = float(atof(argv[4]));
+        }
+        return batch.run(PatternBatch::listFiles(argv[2])) ? 0 : 1;
+    }
+
+    /** Multigrid against a single level on every panel: ClothSimulation --solver-check <pattern> [levels] [time step] **/
+    if (argc >= 3 && std::string(argv[1]) == "--solver-check") {
+        SolverCheck check;
+        if (argc >= 4) {
+            check.levels = atoi(argv[3]);
+        }
+        if (argc >= 5) {
+            check.timeStep = float(atof(argv[4]));
+        }
+        return check.run(argv[2]) ? 0 : 1;
+    }
+
+    /** Load cloths, their materials and sew the seams of the spec, if given **/
+    if (!scene.load("assets/cloth/woman-shirt.dxf", seamFile, materialFile)) {
+        return -1;
+    }
+    if (multigridLevels >= 0) {
+        scene.enableMultigrid(multigridLevels);
+    }
+
     /** Prepare for rendering **/
     // Initialize GLFW
     glfwInit();
@@ -76,6 +126,21 @@ int main(int argc, const char* argv[])
     glfwSetCursorPosCallback(window, mouse_position_callback);
     glfwSetScrollCallback(window, scroll_callback);
 
+    /** Renderers, the body and the rendering loop; their GL objects are deleted before the context goes away **/
+    bool rendered = renderScene();
+    sewMachine.deleteBuffers();
+
+    glfwTerminate();
+
+    return rendered ? 0 : -1;
+}
+
+/*
+ * everything that holds GL objects is local here, so it is destroyed while the window's context still exists
+ * false if the body could not be loaded
+ */
+bool renderScene()
+{
     /** Generate Object Renderers **/
     std::vector<ClothRender> clothRenders;
     std::vector<ClothSpringRender> clothSpringRenders;
@@ -85,19 +150,25 @@ int main(int argc, const char* argv[])
         clothSpringRenders.push_back(ClothSpringRender(cloth));
     }
     // Model
-    Model ourModel("assets/models/man/man_body.obj");
-    ModelRender modelRender(&ourModel);
+    BodyLibrary bodies("assets/cache");
+    std::shared_ptr<Model> ourModel = bodies.get("assets/models/man/man_body.obj");
+    if (!ourModel) {
+        return false;
+    }
+    ModelRender modelRender(ourModel.get());
+    scene.body = &modelRender;
 
     glEnable(GL_DEPTH_TEST);
     glPointSize(3);
 
     // offscreen render, to generate depth maps and normal maps for collision detection and response
     modelRender.offScreenRender(
-        &(ourModel.collisionBox.frontCamera), 
-        &(ourModel.collisionBox.backCamera),
+        &(modelRender.collisionBox.frontCamera), 
+        &(modelRender.collisionBox.backCamera),
         window
     );
 
+
     // cloth self collision
     std::cout << "sphereR: " << clthCollid.sphereR << std::endl;
     std::cout << "cellUnit: " << clthCollid.cellUnit << std::endl;
@@ -119,19 +190,12 @@ int main(int argc, const char* argv[])
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         /** -------------------------------- Simulation & Rendering -------------------------------- **/
+        for (int iter = 0; iter < iterationFreq; iter++) {
+            scene.step((float)TIME_STEP);
+        }
+
         for (size_t i = 0; i < cloths.size(); i += 1)
         {
-            Cloth* cloth = cloths[i];
-            for (int iter = 0; iter < iterationFreq; iter++) {
-                if (cloth->collisionCount < MAX_COLLISION_TIME) {
-                    cloth->update((float)TIME_STEP);
-                    if (cloth->isSewed) {
-                        cloth->modelCollision(modelRender);
-                        //cloth->clothCollision(&clthCollid);
-                    }
-                }
-            }
-        
             /** Display **/
             if (Cloth::drawMode == DRAW_LINES) {
                 clothSpringRenders[i].update(&camera);
@@ -140,7 +204,6 @@ int main(int argc, const char* argv[])
                 clothRenders[i].update(&camera);
             }
         }
-        sewMachine.update((float)TIME_STEP);
         modelRender.flush(&camera);
         sewMachine.drawSewingLine(camera.GetViewMatrix(), camera.GetPerspectiveProjectionMatrix()); // sewing line
         /** -------------------------------- Simulation & Rendering -------------------------------- **/
@@ -149,9 +212,8 @@ int main(int argc, const char* argv[])
         glfwPollEvents(); // Update the status of window
     }
 
-    glfwTerminate();
-
-    return 0;
+    scene.body = nullptr;
+    return true;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
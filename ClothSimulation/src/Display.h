@@ -1,7 +1,7 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
-#include "ClothCreator.h"
+#include "Scene.h"
 #include "MouseRay.h"
 #include "ClothPicker.h"
 #include "ClothSewMachine.h"
@@ -14,9 +14,9 @@ glm::vec3 lightColor(0.7f, 0.7f, 1.0f);
 // Camera
 Camera camera(Perspective, glm::vec3(-1.0f, 20.0f, 16.0f));
 
-// Cloths
-ClothCreator clothCreator = ClothCreator("assets/cloth/woman-shirt.dxf");
-std::vector<Cloth*>& cloths = clothCreator.cloths;
+// Scene: cloths, their seams and the body, loaded in main
+Scene scene(&camera);
+std::vector<Cloth*>& cloths = scene.cloths;
 Cloth* selectedCloth = nullptr; // ѡеƬ
 
 // ײ
@@ -31,6 +31,6 @@ MouseRay mouseRay = MouseRay(&camera);
 ClothPicker clothPicker = ClothPicker(&camera);
 
 // һ
-ClothSewMachine sewMachine = ClothSewMachine(&camera);
+ClothSewMachine& sewMachine = scene.sewMachine;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,169 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Defaults
+const uint64_t FNV_OFFSET = 14695981039346656037ull;
+const uint64_t FNV_PRIME = 1099511628211ull;
+
+/*
+ * read-only view of a whole file mapped into memory, see MappedFile.cpp
+ */
+class MappedFile
+{
+public:
+    const char* data = nullptr;
+    size_t size = 0;
+
+    MappedFile(const std::string& file);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // the file exists, even if it is empty and nothing was mapped
+    bool isOpen() const {
+#ifdef _WIN32
+        return handle != nullptr;
+#else
+        return fd >= 0;
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    void* handle = nullptr;     // HANDLEs; MappedFile.cpp keeps <windows.h> out of every header
+    void* mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+/*
+ * helpers shared by the binary caches: FNV-1a keys, cache file names, bounds-checked reading and atomic writing
+ */
+class FileCache
+{
+public:
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = FNV_OFFSET) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        uint64_t h = seed;
+        for (size_t i = 0; i < size; i++) {
+            h = (h ^ bytes[i]) * FNV_PRIME;
+        }
+        return h;
+    }
+
+    static bool hashFile(const std::string& file, uint64_t& h) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        std::vector<char> buffer(size_t(1) << 16);
+        h = FNV_OFFSET;
+        while (in) {
+            in.read(buffer.data(), buffer.size());
+            h = hash(buffer.data(), size_t(in.gcount()), h);
+        }
+        return true;
+    }
+
+protected:
+    struct Cursor
+    {
+        const char* pos;
+        const char* end;
+        bool ok = true;
+
+        template <typename T>
+        T get() {
+            T v{};
+            if (size_t(end - pos) < sizeof(T)) {
+                ok = false;
+                return v;
+            }
+            memcpy(&v, pos, sizeof(T));
+            pos += sizeof(T);
+            return v;
+        }
+
+        // element count that is checked against the bytes left, so a corrupt file cannot trigger a huge allocation
+        uint32_t count(size_t elementSize) {
+            uint32_t n = get<uint32_t>();
+            if (!ok || size_t(end - pos) / elementSize < n) {
+                ok = false;
+                return 0;
+            }
+            return n;
+        }
+
+        template <typename T>
+        void getArray(std::vector<T>& out, size_t n) {
+            if (!ok || size_t(end - pos) / sizeof(T) < n) {
+                ok = false;
+                return;
+            }
+            out.resize(n);
+            memcpy(out.data(), pos, n * sizeof(T));
+            pos += n * sizeof(T);
+        }
+    };
+
+    /*
+     * <cacheDir>/<stem>-<hash of the source path><extension>, so files with the same name in different folders do not collide
+     */
+    static std::string cachePath(const std::string& cacheDir, const std::string& file, const char* extension) {
+        std::string absolute = std::filesystem::absolute(file).string();
+        char suffix[24];
+        snprintf(suffix, sizeof(suffix), "-%016llx", (unsigned long long)hash(absolute.data(), absolute.size()));
+        return (std::filesystem::path(cacheDir) / (std::filesystem::path(file).stem().string() + suffix + extension)).string();
+    }
+
+    template <typename T>
+    static void put(std::string& buf, const T& v) {
+        buf.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    template <typename T>
+    static void putArray(std::string& buf, const std::vector<T>& v) {
+        buf.append(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+    }
+
+    /*
+     * written to a temporary file first, so concurrent writers and readers never see a partial cache
+     */
+    static bool store(const std::string& path, const std::string& buf) {
+        std::error_code ec;
+        std::filesystem::path target(path);
+        if (target.has_parent_path()) {
+            std::filesystem::create_directories(target.parent_path(), ec);
+        }
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%016llx.tmp", (unsigned long long)std::hash<std::thread::id>()(std::this_thread::get_id()));
+        std::string temporary = path + suffix;
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(buf.data(), std::streamsize(buf.size()));
+            if (!out) {
+                out.close();
+                std::filesystem::remove(temporary, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(temporary, target, ec);
+        if (ec) {
+            std::filesystem::remove(temporary, ec);
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef HINGE_H
+#define HINGE_H
+
+#include <algorithm>
+#include <cmath>
+
+#include "Point.h"
+
+// Defaults
+const float HINGE_MAX_STIFFNESS = 2.0f;     // stiffest hinge relative to one across the diagonal of a grid cell
+
+/*
+ * bending of two triangles (n[0], n[1], n[2]) and (n[1], n[0], n[3]) around their shared edge n[0]-n[1]
+ * the dihedral angle is pulled back to its rest value (Bridson et al., Simulation of Clothing with Folds and Wrinkles)
+ * everything that only depends on the rest shape is computed once, so a hinge is a small stencil of 4 nodes
+ */
+class Hinge
+{
+public:
+    Node* n[4];             // edge, edge, opposite corner of the first triangle, opposite corner of the second one
+    float restSin;          // sin(theta / 2) of the rest angle
+    float stiffnessScale;   // |E|^2 / (|N1| + |N2|) of the rest shape, softened next to slivers
+    float dampingScale;     // |E| of the rest shape, softened alike
+    float stiffness;        // bending coefficient * stiffnessScale
+    float damping;          // damping coefficient * dampingScale
+
+    /*
+     * 'cellSize' is the grid spacing of the mesh in world space; a hinge next to a sliver or a very short edge
+     * is softened to HINGE_MAX_STIFFNESS times a hinge across the diagonal of a grid cell, which would otherwise
+     * be far too stiff for explicit integration
+     */
+    Hinge(Node* e0, Node* e1, Node* o1, Node* o2, float bendingCoef, float dampingCoef, float cellSize)
+    {
+        n[0] = e0;
+        n[1] = e1;
+        n[2] = o1;
+        n[3] = o2;
+        glm::vec3 u[4];
+        float sinHalf, edgeLength, area;
+        if (gradient(u, sinHalf, edgeLength, area)) {
+            // the stencil acts like a spring of about bendingCoef * scale * max |u|^2, 2 / cellSize^2 for a diagonal hinge
+            const float scale = edgeLength * edgeLength / area;
+            float gradient2 = 0.0f;
+            for (const glm::vec3& g : u) {
+                gradient2 = std::max(gradient2, glm::dot(g, g));
+            }
+            const float soften = cellSize > 0.0f ? std::min(1.0f, HINGE_MAX_STIFFNESS * 2.0f / (cellSize * cellSize * scale * gradient2)) : 1.0f;
+            restSin = sinHalf;
+            stiffnessScale = scale * soften;
+            dampingScale = edgeLength * soften;
+        }
+        else {
+            restSin = stiffnessScale = dampingScale = 0.0f;    // a degenerate triangle never bends
+        }
+        setCoefficients(bendingCoef, dampingCoef);
+    }
+
+    /*
+     * coefficients of another material; the rest shape is kept
+     */
+    void setCoefficients(float bendingCoef, float dampingCoef)
+    {
+        stiffness = bendingCoef * stiffnessScale;
+        damping = dampingCoef * dampingScale;
+    }
+
+    /*
+     * forces on the 4 nodes, without applying them; they sum up to zero
+     * returns false (and leaves 'force' untouched) if one of the triangles has collapsed
+     */
+    bool internalForces(glm::vec3 force[4]) const
+    {
+        glm::vec3 u[4];
+        float sinHalf, edgeLength, area;
+        if ((stiffness == 0.0f && damping == 0.0f) || !gradient(u, sinHalf, edgeLength, area)) {
+            return false;
+        }
+        float angularVelocity = 0.0f;
+        for (int i = 0; i < 4; i++) {
+            angularVelocity += glm::dot(u[i], n[i]->velocity);
+        }
+        const float magnitude = -stiffness * (sinHalf - restSin) - damping * angularVelocity;
+        for (int i = 0; i < 4; i++) {
+            force[i] = u[i] * magnitude;
+        }
+        return true;
+    }
+
+private:
+    /*
+     * u[i] = d(theta) / d(n[i]) and sin(theta / 2), theta > 0 when the second triangle folds towards the normal of the first one
+     * 'area' is |N1| + |N2|, twice the area of the two triangles
+     */
+    bool gradient(glm::vec3 u[4], float& sinHalf, float& edgeLength, float& area) const
+    {
+        const glm::vec3 x0 = n[0]->worldPosition, x1 = n[1]->worldPosition;
+        const glm::vec3 x2 = n[2]->worldPosition, x3 = n[3]->worldPosition;
+        const glm::vec3 e = x1 - x0;
+        const glm::vec3 n1 = glm::cross(x2 - x0, x2 - x1);
+        const glm::vec3 n2 = glm::cross(x3 - x1, x3 - x0);
+        const float n1Length2 = glm::dot(n1, n1), n2Length2 = glm::dot(n2, n2);
+        edgeLength = glm::length(e);
+        if (n1Length2 < 1e-12f || n2Length2 < 1e-12f || edgeLength < 1e-6f) {
+            return false;
+        }
+        const float n1Length = sqrtf(n1Length2), n2Length = sqrtf(n2Length2);
+        const glm::vec3 w1 = n1 / n1Length2, w2 = n2 / n2Length2;
+        u[2] = edgeLength * w1;
+        u[3] = edgeLength * w2;
+        u[0] = glm::dot(x2 - x1, e) / edgeLength * w1 + glm::dot(x3 - x1, e) / edgeLength * w2;
+        u[1] = -glm::dot(x2 - x0, e) / edgeLength * w1 - glm::dot(x3 - x0, e) / edgeLength * w2;
+
+        const float cosTheta = glm::dot(n1, n2) / (n1Length * n2Length);
+        sinHalf = sqrtf(std::max(0.0f, (1.0f - cosTheta) * 0.5f));
+        if (glm::dot(glm::cross(n1, n2), e) > 0.0f) {
+            sinHalf = -sinHalf;
+        }
+        area = n1Length + n2Length;
+        return true;
+    }
+};
+
+#endif
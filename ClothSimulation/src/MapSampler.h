@@ -0,0 +1,229 @@
+#ifndef MAP_SAMPLER_H
+#define MAP_SAMPLER_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <float.h>
+
+// the AVX2 path of MapSampler::depths is compiled for every x86 build and picked at run time,
+// so it needs neither /arch:AVX2 nor -mavx2 and the program still runs on CPUs without AVX2
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MAP_SAMPLER_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MAP_SAMPLER_TARGET_AVX2
+#else
+#define MAP_SAMPLER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#include <glm/glm.hpp>
+
+// Defaults
+const int DEPTH_BOUND_TILE = 8;     // texels per side of a tile of the depth bounds
+const float MAP_BACKGROUND = 1.0f;  // depth of texels the body does not cover
+
+/*
+ * clamped, bilinear lookups into a depth map and its normal map
+ * coordinates are in texels as returned by CollisionBox::getFrontPosition/getBackPosition, texel centers at +0.5
+ * optionally keeps the minimum depth of every tile, a lower bound of any sample in that tile for early rejection
+ */
+class MapSampler
+{
+public:
+    int width = 0;
+    int height = 0;
+    const float* depthMap = nullptr;    // width * height
+    const float* normalMap = nullptr;   // width * height * 3
+
+    void reset(const float* depthMap, const float* normalMap, int width, int height, bool bounds) {
+        this->depthMap = depthMap;
+        this->normalMap = normalMap;
+        this->width = width;
+        this->height = height;
+        tilesX = tilesY = 0;
+        tileMin.clear();
+        if (bounds && width > 0 && height > 0) {
+            buildBounds();
+        }
+    }
+
+    bool hasBounds() const {
+        return !tileMin.empty();
+    }
+
+    float depth(float x, float y) const {
+        Footprint f = footprint(x, y);
+        const float top = depthMap[f.i00] + (depthMap[f.i10] - depthMap[f.i00]) * f.fx;
+        const float bottom = depthMap[f.i01] + (depthMap[f.i11] - depthMap[f.i01]) * f.fx;
+        return top + (bottom - top) * f.fy;
+    }
+
+    /*
+     * depth() of n points; 8 at a time with gathers on CPUs with AVX2
+     */
+    void depths(const float* xs, const float* ys, float* out, size_t n) const {
+        size_t i = 0;
+#if defined(MAP_SAMPLER_AVX2)
+        if (hasAvx2()) {
+            i = depthsAvx2(xs, ys, out, n);
+        }
+#endif
+        for (; i < n; i++) {
+            out[i] = depth(xs[i], ys[i]);
+        }
+    }
+
+    /*
+     * texels the body does not cover are left out, so normals do not bend towards the background at the silhouette
+     */
+    glm::vec3 normal(float x, float y) const {
+        Footprint f = footprint(x, y);
+        const size_t index[4] = { f.i00, f.i10, f.i01, f.i11 };
+        const float weight[4] = { (1 - f.fx) * (1 - f.fy), f.fx * (1 - f.fy), (1 - f.fx) * f.fy, f.fx * f.fy };
+        glm::vec3 n(0.0f);
+        float total = 0.0f;
+        for (int k = 0; k < 4; k++) {
+            if (depthMap[index[k]] < MAP_BACKGROUND) {
+                const float* t = normalMap + 3 * index[k];
+                n += weight[k] * glm::vec3(t[0], t[1], t[2]);
+                total += weight[k];
+            }
+        }
+        if (total == 0.0f) {
+            const size_t nearest = index[(f.fx < 0.5f ? 0 : 1) + (f.fy < 0.5f ? 0 : 2)];
+            const float* t = normalMap + 3 * nearest;
+            return glm::vec3(t[0], t[1], t[2]);
+        }
+        const float length = glm::length(n);
+        return length > 0.0f ? n / length : n;
+    }
+
+    /*
+     * no sample within the tile of (x, y) is below this; -FLT_MAX without bounds
+     */
+    float depthBound(float x, float y) const {
+        if (tileMin.empty()) {
+            return -FLT_MAX;
+        }
+        const int tx = int(std::min(std::max(0.0f, x), float(width - 1))) / DEPTH_BOUND_TILE;
+        const int ty = int(std::min(std::max(0.0f, y), float(height - 1))) / DEPTH_BOUND_TILE;
+        return tileMin[size_t(ty) * tilesX + tx];
+    }
+
+private:
+#if defined(MAP_SAMPLER_AVX2)
+    static bool hasAvx2() {
+#if defined(__AVX2__)
+        return true;
+#elif defined(_MSC_VER)
+        static const bool avx2 = [] {
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) {
+                return false;
+            }
+            __cpuid(info, 1);
+            const bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {   // the OS saves the ymm registers
+                return false;
+            }
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+        }();
+        return avx2;
+#else
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2;
+#endif
+    }
+
+    /*
+     * the first n - n % 8 points of depths(); returns how many were done
+     */
+    MAP_SAMPLER_TARGET_AVX2 size_t depthsAvx2(const float* xs, const float* ys, float* out, size_t n) const {
+        size_t i = 0;
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 maxU = _mm256_set1_ps(float(width - 1));
+        const __m256 maxV = _mm256_set1_ps(float(height - 1));
+        const __m256i lastX = _mm256_set1_epi32(width - 1);
+        const __m256i lastY = _mm256_set1_epi32(height - 1);
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i stride = _mm256_set1_epi32(width);
+        for (; i + 8 <= n; i += 8) {
+            __m256 u = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(xs + i), half), zero), maxU);
+            __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(ys + i), half), zero), maxV);
+            __m256i x0 = _mm256_cvttps_epi32(u);
+            __m256i y0 = _mm256_cvttps_epi32(v);
+            __m256 fx = _mm256_sub_ps(u, _mm256_cvtepi32_ps(x0));
+            __m256 fy = _mm256_sub_ps(v, _mm256_cvtepi32_ps(y0));
+            __m256i dx = _mm256_sub_epi32(_mm256_min_epi32(_mm256_add_epi32(x0, one), lastX), x0);
+            __m256i row0 = _mm256_add_epi32(_mm256_mullo_epi32(y0, stride), x0);
+            __m256i row1 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_min_epi32(_mm256_add_epi32(y0, one), lastY), stride), x0);
+            __m256 d00 = _mm256_i32gather_ps(depthMap, row0, 4);
+            __m256 d10 = _mm256_i32gather_ps(depthMap, _mm256_add_epi32(row0, dx), 4);
+            __m256 d01 = _mm256_i32gather_ps(depthMap, row1, 4);
+            __m256 d11 = _mm256_i32gather_ps(depthMap, _mm256_add_epi32(row1, dx), 4);
+            __m256 top = _mm256_add_ps(d00, _mm256_mul_ps(_mm256_sub_ps(d10, d00), fx));
+            __m256 bottom = _mm256_add_ps(d01, _mm256_mul_ps(_mm256_sub_ps(d11, d01), fx));
+            _mm256_storeu_ps(out + i, _mm256_add_ps(top, _mm256_mul_ps(_mm256_sub_ps(bottom, top), fy)));
+        }
+        return i;
+    }
+#endif
+
+    struct Footprint
+    {
+        size_t i00, i10, i01, i11;
+        float fx, fy;
+    };
+
+    int tilesX = 0;
+    int tilesY = 0;
+    std::vector<float> tileMin;
+
+    Footprint footprint(float x, float y) const {
+        const float u = std::min(std::max(0.0f, x - 0.5f), float(width - 1));
+        const float v = std::min(std::max(0.0f, y - 0.5f), float(height - 1));
+        const int x0 = int(u), y0 = int(v);
+        const int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+        Footprint f;
+        f.i00 = size_t(y0) * width + x0;
+        f.i10 = size_t(y0) * width + x1;
+        f.i01 = size_t(y1) * width + x0;
+        f.i11 = size_t(y1) * width + x1;
+        f.fx = u - float(x0);
+        f.fy = v - float(y0);
+        return f;
+    }
+
+    /*
+     * a sample at texel coordinate x reads texels floor(x - 0.5) and the one after it,
+     * so every tile takes the minimum over itself grown by one texel on each side
+     */
+    void buildBounds() {
+        tilesX = (width + DEPTH_BOUND_TILE - 1) / DEPTH_BOUND_TILE;
+        tilesY = (height + DEPTH_BOUND_TILE - 1) / DEPTH_BOUND_TILE;
+        tileMin.assign(size_t(tilesX) * tilesY, FLT_MAX);
+        for (int ty = 0; ty < tilesY; ty++) {
+            const int y0 = std::max(ty * DEPTH_BOUND_TILE - 1, 0);
+            const int y1 = std::min((ty + 1) * DEPTH_BOUND_TILE + 1, height);
+            for (int tx = 0; tx < tilesX; tx++) {
+                const int x0 = std::max(tx * DEPTH_BOUND_TILE - 1, 0);
+                const int x1 = std::min((tx + 1) * DEPTH_BOUND_TILE + 1, width);
+                float m = FLT_MAX;
+                for (int y = y0; y < y1; y++) {
+                    for (int x = x0; x < x1; x++) {
+                        m = std::min(m, depthMap[size_t(y) * width + x]);
+                    }
+                }
+                tileMin[size_t(ty) * tilesX + tx] = m;
+            }
+        }
+    }
+};
+
+#endif
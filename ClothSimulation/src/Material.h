@@ -0,0 +1,106 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+// Default Material Values
+const float STRUCTURAL_COEF = 700.0;
+const float SHEAR_COEF = 700.0;
+const float BENDING_COEF = 1.0f;            // of the dihedral angle of two triangles, see Hinge
+const float BENDING_DAMPING = 0.05f;
+const float SPRING_DAMPING = 2.0f;
+const float DENSITY = 22.7f;                // per square unit of world space; a node of the default grid weighs about 1
+
+/*
+ * fabric of a panel; warp runs along the y axis of the pattern, weft along its x axis
+ * a spring at angle 'a' to the weft gets weft * cos^4(a) + warp * sin^4(a) + shear * 2 sin^2(a) cos^2(a)
+ */
+struct Material
+{
+    std::string name = "default";
+    float warpStiffness = STRUCTURAL_COEF;
+    float weftStiffness = STRUCTURAL_COEF;
+    float shearStiffness = SHEAR_COEF;
+    float bendingStiffness = BENDING_COEF;
+    float density = DENSITY;                // lumped into the nodes by the area of their triangles
+    float damping = SPRING_DAMPING;         // of the springs; bending damping scales with it
+};
+
+/*
+ * named materials and which panel is made of which
+ *   material <name> <warp> <weft> <shear> <bending> <density> <damping>
+ *   panel <panel> <name>
+ * panels are numbered in the order of the pattern file from 0; panels without a line keep the default material
+ * a panel line has to follow the material it names
+ * blank lines and lines starting with '#' are skipped
+ */
+class MaterialLibrary
+{
+public:
+    std::map<std::string, Material> materials;
+    std::map<int, std::string> panels;
+
+    /*
+     * returns false if the file could not be opened, a line is malformed or names an unknown material;
+     * nothing is kept in that case
+     */
+    bool load(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cout << "[MaterialLibrary] " << path << " could not be opened." << std::endl;
+            return false;
+        }
+        std::map<std::string, Material> newMaterials;
+        std::map<int, std::string> newPanels;
+        std::string line;
+        for (int lineNumber = 1; std::getline(in, line); lineNumber++) {
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#') {
+                continue;
+            }
+            std::istringstream fields(line);
+            std::string kind, rest;
+            fields >> kind;
+            bool ok = false;
+            if (kind == "material") {
+                Material m;
+                fields >> m.name >> m.warpStiffness >> m.weftStiffness >> m.shearStiffness >> m.bendingStiffness >> m.density >> m.damping;
+                ok = bool(fields) && m.warpStiffness > 0.0f && m.weftStiffness > 0.0f && m.shearStiffness > 0.0f
+                    && m.bendingStiffness >= 0.0f && m.density > 0.0f && m.damping >= 0.0f;
+                if (ok) {
+                    newMaterials[m.name] = m;
+                }
+            }
+            else if (kind == "panel") {
+                int panel;
+                std::string name;
+                fields >> panel >> name;
+                ok = bool(fields) && panel >= 0 && newMaterials.count(name) > 0;
+                if (ok) {
+                    newPanels[panel] = name;
+                }
+            }
+            if (!ok || fields >> rest) {
+                std::cout << "[MaterialLibrary] " << path << ":" << lineNumber << " is not a material or panel: " << line << std::endl;
+                return false;
+            }
+        }
+        materials = std::move(newMaterials);
+        panels = std::move(newPanels);
+        return true;
+    }
+
+    /*
+     * material of a panel, nullptr if it has none
+     */
+    const Material* forPanel(int panel) const {
+        auto it = panels.find(panel);
+        return it != panels.end() ? &materials.at(it->second) : nullptr;
+    }
+};
+
+#endif
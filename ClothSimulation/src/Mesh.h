@@ -48,6 +48,15 @@ public:
         setupMesh();
     }
 
+    // delete the buffer objects, the mesh cannot be drawn afterwards
+    void release()
+    {
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteVertexArrays(1, &VAO);
+        EBO = VBO = VAO = 0;
+    }
+
     // render the mesh
     void Draw(Shader& shader)
     {
@@ -9,10 +9,46 @@
 #include <assimp/postprocess.h>
 
 #include "Mesh.h"
+#include "ModelCache.h"
 #include "CollisionBox.h"
 
+#include <map>
+#include <memory>
+
 unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma = false);
 
+struct GLTexture
+{
+    unsigned int id;
+
+    GLTexture(unsigned int id) : id(id) {}
+    ~GLTexture() { glDeleteTextures(1, &id); }
+    GLTexture(const GLTexture&) = delete;
+    GLTexture& operator=(const GLTexture&) = delete;
+};
+
+/*
+ * textures shared between models by file path; a texture is deleted once no model holds it anymore
+ */
+class TextureRegistry
+{
+public:
+    std::shared_ptr<GLTexture> load(const char* path, const std::string& directory, bool gamma = false)
+    {
+        const std::string file = directory + '/' + path;
+        std::shared_ptr<GLTexture> texture = textures[file].lock();
+        if (!texture)
+        {
+            texture = std::make_shared<GLTexture>(TextureFromFile(path, directory, gamma));
+            textures[file] = texture;
+        }
+        return texture;
+    }
+
+private:
+    std::map<std::string, std::weak_ptr<GLTexture>> textures;
+};
+
 class Model
 {
 public:
@@ -25,13 +61,75 @@ public:
     // create AABB box, for image-based collision detection
     CollisionBox collisionBox;
 
+    // body cache file and its key, empty if the model is not cached
+    std::string cachePath;
+    uint64_t cacheKey = 0;
+    // latest collision maps of the model, shared by its renders
+    std::shared_ptr<const CollisionMaps> collisionMaps;
+
     // constructor, expects a filepath to a 3D model.
-    Model(std::string const& path, bool gamma = false) : gammaCorrection(gamma)
+    // with a cache folder, the preprocessed body is loaded from there, or written there after the import
+    // with a texture registry, textures are shared with the other models that use it
+    Model(std::string const& path, bool gamma = false, std::string const& cacheDir = "", TextureRegistry* textureRegistry = nullptr)
+        : gammaCorrection(gamma), textureRegistry(textureRegistry)
     {
-        loadModel(path);
+        Body body;
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+        uint64_t sourceHash;
+        if (!cacheDir.empty() && ModelCache::hashFile(path, sourceHash))
+        {
+            cacheKey = ModelCache::hash(&MODEL_CACHE_VERSION, sizeof(MODEL_CACHE_VERSION), sourceHash);
+            cachePath = ModelCache::pathFor(cacheDir, path);
+        }
+        if (!cachePath.empty() && ModelCache::read(cachePath, cacheKey, body))
+        {
+            std::cout << "[Model] loaded from cache " << cachePath << std::endl;
+        }
+        else if (!loadModel(path, body))
+        {
+            cachePath.clear();
+        }
+        else if (!cachePath.empty() && !ModelCache::write(cachePath, cacheKey, body))
+        {
+            std::cout << "[Model] cache could not be written: " << cachePath << std::endl;
+            cachePath.clear();
+        }
+        for (BodyMesh& mesh : body.meshes)
+            meshes.push_back(Mesh(std::move(mesh.vertices), std::move(mesh.indices), loadMaterialTextures(mesh.textures)));
+        if (body.maps.key != 0)
+            collisionMaps = std::make_shared<const CollisionMaps>(std::move(body.maps));
+        if (!body.meshes.empty())
+        {
+            collisionBox.updateBoundary(body.min);
+            collisionBox.updateBoundary(body.max);
+        }
         collisionBox.setBox();
     }
 
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    // deletes the GL buffers of all meshes and drops the shared textures; needs the GL context
+    void release()
+    {
+        for (Mesh& mesh : meshes)
+            mesh.release();
+        sharedTextures.clear();
+    }
+
+    // bytes of the geometry and the collision maps kept in memory
+    size_t memoryBytes() const
+    {
+        size_t bytes = 0;
+        for (const Mesh& mesh : meshes)
+            bytes += mesh.vertices.size() * sizeof(ModelVertex) + mesh.indices.size() * sizeof(unsigned int);
+        if (collisionMaps)
+            bytes += (collisionMaps->frontDepth.size() + collisionMaps->frontNormal.size()
+                + collisionMaps->backDepth.size() + collisionMaps->backNormal.size()) * sizeof(float);
+        return bytes;
+    }
+
     // draws the model, and thus all its meshes
     void Draw(Shader& shader)
     {
@@ -40,8 +138,11 @@ public:
     }
 
 private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes std::vector.
-    void loadModel(std::string const& path)
+    TextureRegistry* textureRegistry;
+    std::vector<std::shared_ptr<GLTexture>> sharedTextures;    // keeps textures of the registry alive
+
+    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in body.
+    bool loadModel(std::string const& path, Body& body)
     {
         // read file via ASSIMP
         Assimp::Importer importer;
@@ -50,17 +151,19 @@ private:
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
-            return;
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        CollisionBox box;
+        processNode(scene->mRootNode, scene, body, box);
+        body.min = glm::vec3(box.minX, box.minY, box.minZ);
+        body.max = glm::vec3(box.maxX, box.maxY, box.maxZ);
+        return true;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
+    void processNode(aiNode* node, const aiScene* scene, Body& body, CollisionBox& box)
     {
         // process each mesh located at the current node
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -68,35 +171,35 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            body.meshes.push_back(processMesh(mesh, scene, box));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, body, box);
         }
 
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    BodyMesh processMesh(aiMesh* mesh, const aiScene* scene, CollisionBox& box)
     {
         // data to fill
-        std::vector<ModelVertex> vertices;
-        std::vector<unsigned int> indices;
-        std::vector<Texture> textures;
+        BodyMesh result;
+        std::vector<ModelVertex>& vertices = result.vertices;
+        std::vector<unsigned int>& indices = result.indices;
 
         // walk through each of the mesh's vertices
         std::cout << "vertex Number: " << mesh->mNumVertices << std::endl;
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            ModelVertex vertex;
+            ModelVertex vertex{};
             glm::vec3 vector; // we declare a placeholder std::vector since assimp uses its own std::vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
-            collisionBox.updateBoundary(vector);
+            box.updateBoundary(vector);
 
             // normals
             if (mesh->HasNormals())
@@ -150,36 +253,43 @@ private:
         // normal: texture_normalN
 
         // 1. diffuse maps
-        std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        materialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", result.textures);
         // 2. specular maps
-        std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        materialTextures(material, aiTextureType_SPECULAR, "texture_specular", result.textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        materialTextures(material, aiTextureType_HEIGHT, "texture_normal", result.textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        materialTextures(material, aiTextureType_AMBIENT, "texture_height", result.textures);
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the mesh data, Mesh objects are created from it once the body is complete
+        return result;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
+    // collects the paths of all material textures of a given type, paired with the sampler name
+    void materialTextures(aiMaterial* mat, aiTextureType type, const std::string& typeName, std::vector<std::pair<std::string, std::string>>& textures)
     {
-        std::vector<Texture> textures;
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
+            textures.emplace_back(typeName, str.C_Str());
+        }
+    }
+
+    // checks the given (type, path) textures and loads the textures if they're not loaded yet.
+    // the required info is returned as a Texture struct.
+    std::vector<Texture> loadMaterialTextures(const std::vector<std::pair<std::string, std::string>>& paths)
+    {
+        std::vector<Texture> textures;
+        for (const std::pair<std::string, std::string>& path : paths)
+        {
+            const std::string& typeName = path.first;
+            const char* str = path.second.c_str();
             // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
             bool skip = false;
             for (unsigned int j = 0; j < textures_loaded.size(); j++)
             {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                if (std::strcmp(textures_loaded[j].path.data(), str) == 0)
                 {
                     textures.push_back(textures_loaded[j]);
                     skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
@@ -189,9 +299,15 @@ private:
             if (!skip)
             {   // if texture hasn't been loaded already, load it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                if (textureRegistry)
+                {
+                    sharedTextures.push_back(textureRegistry->load(str, this->directory));
+                    texture.id = sharedTextures.back()->id;
+                }
+                else
+                    texture.id = TextureFromFile(str, this->directory);
                 texture.type = typeName;
-                texture.path = str.C_Str();
+                texture.path = str;
                 textures.push_back(texture);
                 textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
             }
@@ -0,0 +1,205 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Mesh.h"
+#include "FileCache.h"
+
+// Defaults
+const uint32_t MODEL_CACHE_MAGIC = 0x59444f42;  // "BODY"
+const uint32_t MODEL_CACHE_VERSION = 1;
+
+/*
+ * one mesh of a body, as it is handed to Mesh; textures are (type, path relative to the model's folder)
+ */
+struct BodyMesh
+{
+    std::vector<ModelVertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<std::pair<std::string, std::string>> textures;
+};
+
+/*
+ * depth and normal maps rendered by the front and back cameras of the collision box
+ * only valid for the model matrix and screen size they were rendered with, which 'key' hashes
+ */
+struct CollisionMaps
+{
+    uint64_t key = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<float> frontDepth, frontNormal;
+    std::vector<float> backDepth, backNormal;
+};
+
+struct Body
+{
+    std::vector<BodyMesh> meshes;
+    glm::vec3 min = glm::vec3(0.0f);    // AABB in model space
+    glm::vec3 max = glm::vec3(0.0f);
+    CollisionMaps maps;                 // empty until they are baked once
+};
+
+/*
+ * preprocessed body model, so later runs skip the Assimp import and the AABB pass
+ * a cache file is only used if its key matches the hash of the model file
+ * layout (native byte order, every field 4-byte aligned):
+ *   magic, version, key, size of the geometry part, AABB min, max, mesh count, then per mesh
+ *   vertex count, index count, texture count, ModelVertex array, index array, textures (type, path)
+ *   optionally followed by the collision maps: key, width, height, front depth, front normal, back depth, back normal
+ */
+class ModelCache : public FileCache
+{
+public:
+    /*
+     * <cacheDir>/<stem>-<hash of the source path>.body
+     */
+    static std::string pathFor(const std::string& cacheDir, const std::string& file) {
+        return cachePath(cacheDir, file, ".body");
+    }
+
+    static bool write(const std::string& path, uint64_t key, const Body& body) {
+        std::string buf;
+        put(buf, MODEL_CACHE_MAGIC);
+        put(buf, MODEL_CACHE_VERSION);
+        put(buf, key);
+        put(buf, uint64_t(0));      // geometry size, patched below
+        put(buf, body.min);
+        put(buf, body.max);
+        put(buf, uint32_t(body.meshes.size()));
+        for (const BodyMesh& mesh : body.meshes) {
+            put(buf, uint32_t(mesh.vertices.size()));
+            put(buf, uint32_t(mesh.indices.size()));
+            put(buf, uint32_t(mesh.textures.size()));
+            putArray(buf, mesh.vertices);
+            putArray(buf, mesh.indices);
+            for (const std::pair<std::string, std::string>& texture : mesh.textures) {
+                putString(buf, texture.first);
+                putString(buf, texture.second);
+            }
+        }
+        const uint64_t geometry = buf.size();
+        memcpy(&buf[16], &geometry, sizeof(geometry));
+        if (body.maps.key != 0) {
+            putMaps(buf, body.maps);
+        }
+        return store(path, buf);
+    }
+
+    /*
+     * add or replace the collision maps of an existing cache file, keeping its geometry as it is
+     */
+    static bool writeMaps(const std::string& path, uint64_t key, const CollisionMaps& maps) {
+        std::string buf;
+        {
+            MappedFile file(path);
+            Cursor cur{ file.data, file.data + file.size };
+            if (!file.data || cur.get<uint32_t>() != MODEL_CACHE_MAGIC || cur.get<uint32_t>() != MODEL_CACHE_VERSION || cur.get<uint64_t>() != key) {
+                return false;
+            }
+            const uint64_t geometry = cur.get<uint64_t>();
+            if (!cur.ok || geometry > file.size) {
+                return false;
+            }
+            buf.assign(file.data, size_t(geometry));
+        }
+        putMaps(buf, maps);
+        return store(path, buf);
+    }
+
+    /*
+     * nothing is changed in 'body' unless the whole file is valid
+     */
+    static bool read(const std::string& path, uint64_t key, Body& body) {
+        MappedFile file(path);
+        if (!file.data) {
+            return false;
+        }
+        Cursor cur{ file.data, file.data + file.size };
+        if (cur.get<uint32_t>() != MODEL_CACHE_MAGIC || cur.get<uint32_t>() != MODEL_CACHE_VERSION || cur.get<uint64_t>() != key) {
+            return false;
+        }
+        const uint64_t geometry = cur.get<uint64_t>();
+        Body newBody;
+        newBody.min = cur.get<glm::vec3>();
+        newBody.max = cur.get<glm::vec3>();
+        const uint32_t mesh_sz = cur.count(12);
+        newBody.meshes.resize(mesh_sz);
+        for (uint32_t m = 0; m < mesh_sz && cur.ok; m++) {
+            BodyMesh& mesh = newBody.meshes[m];
+            const uint32_t vertex_sz = cur.get<uint32_t>();
+            const uint32_t index_sz = cur.get<uint32_t>();
+            const uint32_t texture_sz = cur.get<uint32_t>();
+            cur.getArray(mesh.vertices, vertex_sz);
+            cur.getArray(mesh.indices, index_sz);
+            for (uint32_t t = 0; t < texture_sz && cur.ok; t++) {
+                std::string type = getString(cur);
+                std::string texturePath = getString(cur);
+                mesh.textures.emplace_back(std::move(type), std::move(texturePath));
+            }
+            for (unsigned int i : mesh.indices) {
+                if (i >= vertex_sz) {
+                    cur.ok = false;
+                    break;
+                }
+            }
+        }
+        if (!cur.ok || uint64_t(cur.pos - file.data) != geometry) {
+            return false;
+        }
+
+        if (cur.pos != cur.end) {
+            CollisionMaps& maps = newBody.maps;
+            maps.key = cur.get<uint64_t>();
+            maps.width = cur.get<int32_t>();
+            maps.height = cur.get<int32_t>();
+            const size_t resolution = maps.width > 0 && maps.height > 0 ? size_t(maps.width) * size_t(maps.height) : 0;
+            if (!cur.ok || resolution == 0 || size_t(cur.end - cur.pos) != resolution * 8 * sizeof(float)) {
+                return false;
+            }
+            cur.getArray(maps.frontDepth, resolution);
+            cur.getArray(maps.frontNormal, resolution * 3);
+            cur.getArray(maps.backDepth, resolution);
+            cur.getArray(maps.backNormal, resolution * 3);
+        }
+        body = std::move(newBody);
+        return true;
+    }
+
+private:
+    static size_t padded(size_t n) {
+        return (n + 3) & ~size_t(3);
+    }
+
+    static std::string getString(Cursor& cur) {
+        const uint32_t n = cur.count(1);
+        if (!cur.ok || size_t(cur.end - cur.pos) < padded(n)) {
+            cur.ok = false;
+            return std::string();
+        }
+        std::string s(cur.pos, n);
+        cur.pos += padded(n);
+        return s;
+    }
+
+    static void putString(std::string& buf, const std::string& s) {
+        put(buf, uint32_t(s.size()));
+        buf.append(s);
+        buf.append(padded(s.size()) - s.size(), '\0');
+    }
+
+    static void putMaps(std::string& buf, const CollisionMaps& maps) {
+        put(buf, maps.key);
+        put(buf, int32_t(maps.width));
+        put(buf, int32_t(maps.height));
+        putArray(buf, maps.frontDepth);
+        putArray(buf, maps.frontNormal);
+        putArray(buf, maps.backDepth);
+        putArray(buf, maps.backNormal);
+    }
+};
+
+#endif
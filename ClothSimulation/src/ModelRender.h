@@ -1,13 +1,34 @@
 #ifndef MODEL_RENDER_H
 #define MODEL_RENDER_H
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "MapSampler.h"
 #include "Model.h"
+#include "ThreadPool.h"
 
 typedef unsigned int uint;
 
+// Defaults
+const float COLLISION_TOLERANCE = 0.05f;    // nodes this close in front of both depth maps collide already
+const float CONTACT_SKIN = 0.01f;          // distance kept between a colliding node and the body surface
+const float CONTACT_FRICTION = 0.5f;        // Coulomb friction coefficient between cloth and body
+const float CONTACT_RESTITUTION = 0.0f;     // share of the approaching normal velocity that bounces back
+const size_t COLLISION_BLOCK = 256;         // nodes per block of collideBatch
+
 class ModelRender
 {
 public:
+    // collision box of the model in world space
+    CollisionBox collisionBox;
+    // keep the minimum depth of every map tile to reject nodes early; read when the maps are set up
+    bool depthBounds = true;
+    float friction = CONTACT_FRICTION;
+    float restitution = CONTACT_RESTITUTION;
+
+    // several renders may share one model, which must outlive them
     ModelRender(Model* model)
     {
         this->model = model;
@@ -16,10 +37,6 @@ public:
 
     ~ModelRender()
     {
-        delete[]frontDepthMap;
-        delete[]frontNormalMap;
-        delete[]backDepthMap;
-        delete[]backNormalMap;
         // detele shaders
         if (runtimeShader.ID) {
             glDeleteProgram(runtimeShader.ID);
@@ -40,15 +57,28 @@ public:
         // screen size
         glfwGetWindowSize(window, &scr_width, &scr_height);
         const size_t resolution = scr_width * scr_height;
-        model->collisionBox.scr_width = scr_width;
-        model->collisionBox.scr_height = scr_height;
-
-        frontDepthMap = new float[resolution];
-        frontNormalMap = new float[resolution * 3];
-        backDepthMap = new float[resolution];
-        backNormalMap = new float[resolution * 3];
+        collisionBox.scr_width = scr_width;
+        collisionBox.scr_height = scr_height;
         std::cout << "framebuffer window size:(" << scr_width << ", " << scr_width << ")\n";
 
+        // maps of the same model matrix and screen size, from the body cache or another render of this model
+        const uint64_t mapKey = collisionMapKey();
+        std::shared_ptr<const CollisionMaps> shared = model->collisionMaps;
+        if (shared && shared->key == mapKey && shared->width == scr_width && shared->height == scr_height) {
+            useMaps(shared);
+            std::cout << "collision maps reused\n";
+            return;
+        }
+
+        std::shared_ptr<CollisionMaps> maps = std::make_shared<CollisionMaps>();
+        maps->key = mapKey;
+        maps->width = scr_width;
+        maps->height = scr_height;
+        maps->frontDepth.resize(resolution);
+        maps->frontNormal.resize(resolution * 3);
+        maps->backDepth.resize(resolution);
+        maps->backNormal.resize(resolution * 3);
+
         // framebuffer configuration
         // -------------------------
         uint framebuffer;
@@ -76,20 +106,29 @@ public:
         }
 
         // generate depth and normal maps for the front camera
-        createMap(textureColorbuffer, textureDepthbuffer, window, frontCamera, frontDepthMap, frontNormalMap);
+        createMap(textureColorbuffer, textureDepthbuffer, window, frontCamera, maps->frontDepth.data(), maps->frontNormal.data());
 
         // generate depth and normal maps for the back camera
-        createMap(textureColorbuffer, textureDepthbuffer, window, backCamera, backDepthMap, backNormalMap);
+        createMap(textureColorbuffer, textureDepthbuffer, window, backCamera, maps->backDepth.data(), maps->backNormal.data());
 
         // normal coords transformation
         for (size_t i = 0; i < resolution * 3; i += 1) {
-            frontNormalMap[i] = 2 * frontNormalMap[i] - 1;
-            backNormalMap[i] = 2 * backNormalMap[i] - 1;
+            maps->frontNormal[i] = 2 * maps->frontNormal[i] - 1;
+            maps->backNormal[i] = 2 * maps->backNormal[i] - 1;
         }
+        useMaps(maps);
+        model->collisionMaps = maps;
 
         glDeleteFramebuffers(1, &framebuffer);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glUseProgram(0);
+
+        // bake the maps into the body cache for the next start
+        if (!model->cachePath.empty()) {
+            if (!ModelCache::writeMaps(model->cachePath, model->cacheKey, *maps)) {
+                std::cout << "collision maps could not be cached\n";
+            }
+        }
     }
 
     /*
@@ -111,19 +150,18 @@ public:
     {
         glm::vec3 point = node->worldPosition;
         // жǷײ
-        if (!model->collisionBox.collideWithPoint(point)) {
+        if (!collisionBox.collideWithPoint(point)) {
             return false;
         }
 
         // ȡ(ǰ)ϵͳµ
-        glm::vec3 frontPos = model->collisionBox.getFrontPosition(point);
-        glm::vec3 backPos = model->collisionBox.getBackPosition(point);
+        glm::vec3 frontPos = collisionBox.getFrontPosition(point);
+        glm::vec3 backPos = collisionBox.getBackPosition(point);
 
-        float z_front = getDepth(frontPos, frontDepthMap);
-        float z_back = getDepth(backPos, backDepthMap);
+        float z_front = getDepth(frontPos, frontMap);
+        float z_back = getDepth(backPos, backMap);
 
-        float tolerance = 0.05f;
-        return (frontPos.z >= z_front - tolerance && backPos.z >= z_back - tolerance);
+        return (frontPos.z >= z_front - COLLISION_TOLERANCE && backPos.z >= z_back - COLLISION_TOLERANCE);
     }
 
     /*
@@ -132,34 +170,49 @@ public:
      */
     void collisionResponse(Node* node)
     {
-        glm::vec3 frontPosition = model->collisionBox.getFrontPosition(node->worldPosition);
-        glm::vec3 backPosition = model->collisionBox.getBackPosition(node->worldPosition);
+        glm::vec3 frontPosition = collisionBox.getFrontPosition(node->worldPosition);
+        glm::vec3 backPosition = collisionBox.getBackPosition(node->worldPosition);
 
         // ȡײ㴦ķ
         //  [x, y] Ӧģ ǰ   , Ҫж [x, y] ǰǺ󲿸
-        float z_front = getDepth(frontPosition, frontDepthMap);
-        float z_back = getDepth(backPosition, backDepthMap);
-        glm::vec3 normal = fabs(frontPosition.z - z_front) < fabs(backPosition.z - z_back) ?
-            getNormal(frontPosition, frontNormalMap) :
-            getNormal(backPosition, backNormalMap);
-
-        // ʵŵǰƽһξ
-        float epsilon = 0.03f;
-        node->worldPosition += normal * epsilon;
-        // ٶȡ
-        node->velocity *= -0.01f;
+        float z_front = getDepth(frontPosition, frontMap);
+        float z_back = getDepth(backPosition, backMap);
+        const bool front = fabs(frontPosition.z - z_front) < fabs(backPosition.z - z_back);
+        glm::vec3 normal = front ? getNormal(frontPosition, frontMap) : getNormal(backPosition, backMap);
+        float depth = front ? frontPosition.z - z_front : backPosition.z - z_back;
+
+        respond(node->worldPosition, node->velocity, normal, depth);
+    }
+
+    /*
+     * collision detection and response for a whole cloth, same result as collideWithModel and collisionResponse per node
+     * positions and velocities are contiguous arrays, split into blocks over the thread pool
+     * hit[i] is set to 1 for colliding nodes and to 0 otherwise; returns the number of colliding nodes
+     */
+    size_t collideBatch(glm::vec3* positions, glm::vec3* velocities, uint8_t* hit, size_t count) const
+    {
+        std::atomic<size_t> hits(0);
+        threadPool().parallelFor(count, COLLISION_BLOCK * 4, [&](size_t begin, size_t end) {
+            size_t blockHits = 0;
+            for (size_t first = begin; first < end; first += COLLISION_BLOCK) {
+                const size_t n = std::min(COLLISION_BLOCK, end - first);
+                blockHits += collideBlock(positions + first, velocities + first, hit + first, n);
+            }
+            hits += blockHits;
+        });
+        return hits;
     }
 
 private:
     int scr_width;
     int scr_height;
     Model* model;
+    glm::mat4 modelMatrix;
     Shader runtimeShader;
     Shader offlineShader;
-    float* frontDepthMap;
-    float* backDepthMap;
-    float* frontNormalMap;
-    float* backNormalMap;
+    std::shared_ptr<const CollisionMaps> maps;  // may be shared with other renders of the same model
+    MapSampler frontMap;
+    MapSampler backMap;
 
     void init()
     {
@@ -167,11 +220,12 @@ private:
         offlineShader = Shader("src/shaders/offscreenVS.glsl", "src/shaders/offscreenFS.glsl");
 
         // model matrix
-        glm::mat4 modelMatrix = glm::mat4(1.0f);
+        modelMatrix = glm::mat4(1.0f);
         modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, -3.0f, -2.5f));      // translate it down so it's at the center of the scene
         modelMatrix = glm::scale(modelMatrix, glm::vec3(0.08f, 0.08f, 0.08f));	       // it's a bit too big for our scene, so scale it down
 
-        model->collisionBox.toWorldPosition(modelMatrix);  // change the position of AABB box accordingly
+        collisionBox = model->collisionBox;
+        collisionBox.toWorldPosition(modelMatrix);  // change the position of AABB box accordingly
 
         runtimeShader.use();
         runtimeShader.setMat4("model", modelMatrix);
@@ -182,6 +236,122 @@ private:
         glUseProgram(0);
     }
 
+    /*
+     * at most COLLISION_BLOCK nodes: a branch-free pass rejects everything outside the box,
+     * then each remaining node is projected once for both cameras and checked against the depth bounds,
+     * the depths of the rest are sampled in one batch per map
+     */
+    size_t collideBlock(glm::vec3* positions, glm::vec3* velocities, uint8_t* hit, size_t count) const
+    {
+        const CollisionBox& box = collisionBox;
+        const glm::vec3 half(box.length / 2, box.height / 2, box.width / 2);
+        uint32_t inside[COLLISION_BLOCK];
+        size_t candidates = 0;
+        for (size_t i = 0; i < count; i++) {
+            const glm::vec3 delta = glm::abs(positions[i] - box.centroid);
+            hit[i] = 0;
+            inside[candidates] = uint32_t(i);
+            candidates += size_t((delta.x < half.x) & (delta.y < half.y) & (delta.z < half.z));
+        }
+
+        float frontX[COLLISION_BLOCK], backX[COLLISION_BLOCK], imageY[COLLISION_BLOCK];
+        float frontZ[COLLISION_BLOCK], backZ[COLLISION_BLOCK];
+        size_t kept = 0;
+        for (size_t c = 0; c < candidates; c++) {
+            const uint32_t i = inside[c];
+            // the cameras face each other: y is shared, x and z are mirrored (see getFrontPosition and getBackPosition)
+            const glm::vec3 p = positions[i] - box.origin;
+            const float y = p.y * box.scr_height / box.phi;
+            const glm::vec3 front((p.x + box.phi / 2) * box.scr_width / box.phi, y, (box.width - p.z) / box.width);
+            const glm::vec3 back((box.phi / 2 - p.x) * box.scr_width / box.phi, y, p.z / box.width);
+            // no depth in the tile is below its bound, so a node in front of the bound cannot collide
+            if (front.z < frontMap.depthBound(front.x, y) - COLLISION_TOLERANCE ||
+                back.z < backMap.depthBound(back.x, y) - COLLISION_TOLERANCE) {
+                continue;
+            }
+            inside[kept] = i;
+            frontX[kept] = front.x;
+            backX[kept] = back.x;
+            imageY[kept] = y;
+            frontZ[kept] = front.z;
+            backZ[kept] = back.z;
+            kept += 1;
+        }
+
+        float frontDepth[COLLISION_BLOCK], backDepth[COLLISION_BLOCK];
+        frontMap.depths(frontX, imageY, frontDepth, kept);
+        backMap.depths(backX, imageY, backDepth, kept);
+
+        size_t hits = 0;
+        for (size_t k = 0; k < kept; k++) {
+            const uint32_t i = inside[k];
+            const float z_front = frontDepth[k];
+            const float z_back = backDepth[k];
+            if (frontZ[k] < z_front - COLLISION_TOLERANCE || backZ[k] < z_back - COLLISION_TOLERANCE) {
+                continue;
+            }
+            const bool front = fabs(frontZ[k] - z_front) < fabs(backZ[k] - z_back);
+            const glm::vec3 normal = front ? frontMap.normal(frontX[k], imageY[k]) : backMap.normal(backX[k], imageY[k]);
+            respond(positions[i], velocities[i], normal, front ? frontZ[k] - z_front : backZ[k] - z_back);
+            hit[i] = 1;
+            hits += 1;
+        }
+        return hits;
+    }
+
+    /*
+     * contact response of one colliding node
+     * 'depth' is how far behind the surface the node is in map units along the camera axis (negative inside the tolerance);
+     * projected on the normal it gives the penetration, the node is moved out by it plus the skin
+     * an approaching normal velocity is reflected with the restitution, and Coulomb friction takes
+     * friction * (normal velocity change) off the tangential velocity, stopping it if that is not more
+     */
+    void respond(glm::vec3& position, glm::vec3& velocity, glm::vec3 normal, float depth) const
+    {
+        const float length = glm::length(normal);
+        if (length == 0.0f) {
+            return;
+        }
+        normal /= length;
+
+        const float penetration = depth * collisionBox.width * fabs(normal.z);
+        if (penetration + CONTACT_SKIN > 0.0f) {
+            position += normal * (penetration + CONTACT_SKIN);
+        }
+
+        const float vn = glm::dot(velocity, normal);
+        if (vn >= 0.0f) {
+            return;
+        }
+        glm::vec3 tangential = velocity - vn * normal;
+        const float impulse = -(1.0f + restitution) * vn;
+        const float speed = glm::length(tangential);
+        if (speed <= friction * impulse) {
+            tangential = glm::vec3(0.0f);
+        }
+        else {
+            tangential *= 1.0f - friction * impulse / speed;
+        }
+        velocity = tangential - restitution * vn * normal;
+    }
+
+    void useMaps(const std::shared_ptr<const CollisionMaps>& shared)
+    {
+        maps = shared;
+        frontMap.reset(maps->frontDepth.data(), maps->frontNormal.data(), maps->width, maps->height, depthBounds);
+        backMap.reset(maps->backDepth.data(), maps->backNormal.data(), maps->width, maps->height, depthBounds);
+    }
+
+    /*
+     * identifies what the collision maps depend on: the model matrix and the screen size
+     */
+    uint64_t collisionMapKey() const
+    {
+        uint64_t h = ModelCache::hash(&modelMatrix, sizeof(modelMatrix));
+        h = ModelCache::hash(&scr_width, sizeof(scr_width), h);
+        return ModelCache::hash(&scr_height, sizeof(scr_height), h);
+    }
+
     /*
      * create depth map and normal map
      */
@@ -206,23 +376,18 @@ private:
      * ȡ
      * point ͼϵͳµ,  collisionBox.getFrontPosition/getBackPosition ص
      */
-    float getDepth(const glm::vec2& point, float* depthMap) const
+    float getDepth(const glm::vec2& point, const MapSampler& map) const
     {
-        const int x = point.x;
-        const int y = point.y;
-        return depthMap[y * scr_width + x];
+        return map.depth(point.x, point.y);
     }
 
     /*
      * ȡ
      * point ͼϵͳµ,  collisionBox.getFrontPosition/getBackPosition ص
      */
-    glm::vec3 getNormal(const glm::vec2& point, float* normalMap) const
+    glm::vec3 getNormal(const glm::vec2& point, const MapSampler& map) const
     {
-        const int x = point.x;
-        const int y = point.y;
-        int index = 3 * (y * scr_width + x);
-        return glm::vec3(normalMap[index], normalMap[index + 1], normalMap[index + 2]);
+        return map.normal(point.x, point.y);
     }
 };
 
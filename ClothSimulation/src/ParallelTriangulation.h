@@ -0,0 +1,479 @@
+#ifndef PARALLEL_TRIANGULATION_H
+#define PARALLEL_TRIANGULATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <CDT/CDT.h>
+
+#include "ThreadPool.h"
+
+// Defaults
+const size_t PARALLEL_CDT_MIN_VERTICES = 50000;     // smaller inputs are triangulated in one piece
+const size_t PARALLEL_CDT_MIN_STRIP = 10000;        // fewest vertices worth a strip of their own
+const size_t PARALLEL_CDT_MAX_STRIPS = 16;
+const size_t PARALLEL_CDT_MAX_DISK_CELLS = 64;      // triangles with larger circumcircles are left to the seam pass
+
+/*
+ * constrained Delaunay triangulation of a large point set, divided into vertical strips
+ * 1. every strip is triangulated on its own, concurrently
+ * 2. a strip triangle is kept if no point of the whole set lies inside its circumcircle and no constraint edge
+ *    comes near it; such a triangle belongs to the triangulation of the whole set
+ * 3. everything else (the seams between strips, a band around the constraints, the hull) is triangulated once more,
+ *    from the points there and with the outline of the kept triangles as extra constraints
+ * 4. outer triangles and holes are erased by depth-peeling from the hull, like eraseOuterTrianglesAndHoles
+ * 'cdt' ends up as eraseOuterTrianglesAndHoles leaves it: the input vertices in their order, triangles with neighbors,
+ * fixedEdges and vertTris; only the choice of diagonal on co-circular points may differ
+ * the strips depend on the input alone, never on the pool size, so the result is the same on any number of threads
+ */
+class ParallelTriangulation
+{
+public:
+    /*
+     * returns false and leaves 'cdt' untouched if the input is too small to divide or a strip cannot be triangulated;
+     * the caller then triangulates it in one piece
+     */
+    static bool triangulate(const std::vector<CDT::V2d<float>>& vertices, const std::vector<CDT::Edge>& edges,
+        CDT::Triangulation<float>& cdt) {
+        const size_t n = vertices.size();
+        const size_t stripCount = std::min(PARALLEL_CDT_MAX_STRIPS, n / PARALLEL_CDT_MIN_STRIP);
+        if (n < PARALLEL_CDT_MIN_VERTICES || stripCount < 2) {
+            return false;
+        }
+
+        PointGrid grid(vertices);
+        if (!grid.valid) {
+            return false;
+        }
+        for (const CDT::Edge& e : edges) {
+            grid.markSegment(vertices[e.v1()], vertices[e.v2()]);
+        }
+
+        // strips are runs of whole grid columns with nearly equal numbers of points, so they never overlap
+        std::vector<size_t> bounds(1, 0);
+        size_t count = 0;
+        for (size_t c = 0; c + 1 < grid.cols && bounds.size() < stripCount; c++) {
+            for (size_t r = 0; r < grid.rows; r++) {
+                count += grid.cellStart[r * grid.cols + c + 1] - grid.cellStart[r * grid.cols + c];
+            }
+            if (count >= bounds.size() * n / stripCount) {
+                bounds.push_back(c + 1);
+            }
+        }
+        bounds.push_back(grid.cols);
+        if (bounds.size() < 3) {
+            return false;
+        }
+
+        std::vector<Strip> strips(bounds.size() - 1);
+        std::vector<char> inner(n, 0);  // vertices surrounded by kept triangles only
+        std::atomic<bool> failed(false);
+        threadPool().parallelFor(strips.size(), [&](size_t s) {
+            try {
+                triangulateStrip(grid, bounds[s], bounds[s + 1], strips[s], inner);
+            }
+            catch (const std::exception&) {
+                failed = true;
+            }
+        });
+        if (failed) {
+            return false;
+        }
+
+        // seam pass over every vertex that is not inside the kept triangles
+        std::vector<CDT::VertInd> seamToGlobal;
+        std::vector<CDT::VertInd> globalToSeam(n, CDT::noVertex);
+        std::vector<CDT::V2d<float>> seamPoints;
+        for (size_t v = 0; v < n; v++) {
+            if (!inner[v]) {
+                globalToSeam[v] = CDT::VertInd(seamPoints.size());
+                seamToGlobal.push_back(CDT::VertInd(v));
+                seamPoints.push_back(vertices[v]);
+            }
+        }
+        std::vector<CDT::Edge> seamEdges;
+        CDT::EdgeUSet outline;          // outline of the kept triangles, global indices
+        CDT::EdgeUSet seamOutline;      // the same edges in the seam triangulation (+3 for its super-triangle)
+        for (const Strip& strip : strips) {
+            for (const CDT::Edge& e : strip.outline) {
+                seamEdges.push_back(CDT::Edge(globalToSeam[e.v1()], globalToSeam[e.v2()]));
+                seamOutline.insert(CDT::Edge(globalToSeam[e.v1()] + 3, globalToSeam[e.v2()] + 3));
+                outline.insert(e);
+            }
+        }
+        for (const CDT::Edge& e : edges) {
+            // a constraint vertex is never inside: every triangle touching it is near a constraint
+            if (globalToSeam[e.v1()] == CDT::noVertex || globalToSeam[e.v2()] == CDT::noVertex) {
+                return false;
+            }
+            seamEdges.push_back(CDT::Edge(globalToSeam[e.v1()], globalToSeam[e.v2()]));
+        }
+
+        CDT::Triangulation<float> seam(CDT::VertexInsertionOrder::BRIO);
+        try {
+            seam.insertVertices(seamPoints);
+            seam.insertEdges(seamEdges);
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+
+        // kept strip triangles, then the seam triangles outside the outline (at even depth behind it)
+        CDT::TriangleVec triangles;
+        for (const Strip& strip : strips) {
+            const CDT::TriInd offset = CDT::TriInd(triangles.size());
+            for (CDT::Triangle t : strip.kept) {
+                for (CDT::Index i = 0; i < 3; i++) {
+                    if (t.neighbors[i] != CDT::noNeighbor) {
+                        t.neighbors[i] += offset;
+                    }
+                }
+                triangles.push_back(t);
+            }
+        }
+        const std::vector<CDT::LayerDepth> seamDepths =
+            CDT::CalculateTriangleDepths(seam.vertTris[0].front(), seam.triangles, seamOutline);
+        std::vector<CDT::TriInd> seamIndex(seam.triangles.size(), CDT::noNeighbor);
+        for (size_t iT = 0, next = triangles.size(); iT < seam.triangles.size(); iT++) {
+            const CDT::VerticesArr3& v = seam.triangles[iT].vertices;
+            if (seamDepths[iT] % 2 == 0 && v[0] >= 3 && v[1] >= 3 && v[2] >= 3) {
+                seamIndex[iT] = CDT::TriInd(next++);
+            }
+        }
+        for (size_t iT = 0; iT < seam.triangles.size(); iT++) {
+            if (seamIndex[iT] == CDT::noNeighbor) {
+                continue;
+            }
+            CDT::Triangle t = seam.triangles[iT];
+            for (CDT::Index i = 0; i < 3; i++) {
+                t.vertices[i] = seamToGlobal[t.vertices[i] - 3];
+                t.neighbors[i] = t.neighbors[i] == CDT::noNeighbor ? CDT::noNeighbor : seamIndex[t.neighbors[i]];
+            }
+            triangles.push_back(t);
+        }
+        linkAcrossOutline(triangles);
+
+        CDT::EdgeUSet fixedEdges;
+        for (const CDT::Edge& e : seam.fixedEdges) {
+            CDT::Edge g(seamToGlobal[e.v1() - 3], seamToGlobal[e.v2() - 3]);
+            if (!outline.count(g)) {
+                fixedEdges.insert(g);
+            }
+        }
+        eraseOuterTrianglesAndHoles(triangles, fixedEdges, n);
+
+        // triangles around every vertex, counted first so the lists can be filled concurrently
+        std::vector<uint32_t> firstTri(n + 1, 0);
+        for (const CDT::Triangle& t : triangles) {
+            for (CDT::Index i = 0; i < 3; i++) {
+                firstTri[t.vertices[i] + 1] += 1;
+            }
+        }
+        for (size_t v = 0; v < n; v++) {
+            firstTri[v + 1] += firstTri[v];
+        }
+        std::vector<CDT::TriInd> aroundVertex(firstTri[n]);
+        std::vector<uint32_t> fill(firstTri.begin(), firstTri.end() - 1);
+        for (size_t iT = 0; iT < triangles.size(); iT++) {
+            for (CDT::Index i = 0; i < 3; i++) {
+                aroundVertex[fill[triangles[iT].vertices[i]]++] = CDT::TriInd(iT);
+            }
+        }
+        std::vector<CDT::TriIndVec> vertTris(n);
+        threadPool().parallelFor(n, PARALLEL_CDT_MIN_STRIP, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++) {
+                vertTris[v].assign(aroundVertex.begin() + firstTri[v], aroundVertex.begin() + firstTri[v + 1]);
+            }
+        });
+
+        cdt.vertices = vertices;
+        cdt.triangles.swap(triangles);
+        cdt.fixedEdges.swap(fixedEdges);
+        cdt.vertTris.swap(vertTris);
+        return true;
+    }
+
+private:
+    struct Strip
+    {
+        CDT::TriangleVec kept;              // global vertex indices; neighbors index 'kept', none across the outline
+        std::vector<CDT::Edge> outline;     // edges of kept triangles next to a triangle that is not kept
+    };
+
+    /*
+     * points bucketed into square cells of about two points each;
+     * cells crossed by a constraint edge are marked
+     */
+    struct PointGrid
+    {
+        const std::vector<CDT::V2d<float>>& points;
+        double minX, minY, cell;
+        size_t cols, rows;
+        std::vector<uint32_t> cellStart;    // points of cell c are cellPoints[cellStart[c], cellStart[c + 1])
+        std::vector<CDT::VertInd> cellPoints;
+        std::vector<char> marked;
+        bool valid;
+
+        PointGrid(const std::vector<CDT::V2d<float>>& vertices) : points(vertices) {
+            double maxX, maxY;
+            minX = maxX = points[0].x;
+            minY = maxY = points[0].y;
+            for (const CDT::V2d<float>& p : points) {
+                minX = std::min(minX, double(p.x)), maxX = std::max(maxX, double(p.x));
+                minY = std::min(minY, double(p.y)), maxY = std::max(maxY, double(p.y));
+            }
+            const double area = (maxX - minX) * (maxY - minY);
+            valid = area > 0.0;
+            if (!valid) {
+                return;
+            }
+            cell = sqrt(2.0 * area / points.size());
+            cols = size_t((maxX - minX) / cell) + 1;
+            rows = size_t((maxY - minY) / cell) + 1;
+
+            cellStart.assign(cols * rows + 1, 0);
+            for (const CDT::V2d<float>& p : points) {
+                cellStart[cellOf(p.x, p.y) + 1] += 1;
+            }
+            for (size_t c = 0; c < cols * rows; c++) {
+                cellStart[c + 1] += cellStart[c];
+            }
+            cellPoints.resize(points.size());
+            std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+            for (size_t i = 0; i < points.size(); i++) {
+                cellPoints[fill[cellOf(points[i].x, points[i].y)]++] = CDT::VertInd(i);
+            }
+            marked.assign(cols * rows, 0);
+        }
+
+        size_t column(double x) const { return std::min(cols - 1, size_t(std::max(0.0, (x - minX) / cell))); }
+        size_t row(double y) const { return std::min(rows - 1, size_t(std::max(0.0, (y - minY) / cell))); }
+        size_t cellOf(double x, double y) const { return row(y) * cols + column(x); }
+
+        // pieces no longer than a cell, each marking the cells of its bounding box
+        void markSegment(const CDT::V2d<float>& a, const CDT::V2d<float>& b) {
+            const double length = sqrt(double(b.x - a.x) * (b.x - a.x) + double(b.y - a.y) * (b.y - a.y));
+            const int pieces = std::max(1, int(ceil(length / cell)));
+            for (int k = 0; k < pieces; k++) {
+                const double t0 = double(k) / pieces, t1 = double(k + 1) / pieces;
+                const double x0 = a.x + t0 * (b.x - a.x), x1 = a.x + t1 * (b.x - a.x);
+                const double y0 = a.y + t0 * (b.y - a.y), y1 = a.y + t1 * (b.y - a.y);
+                for (size_t r = row(std::min(y0, y1)); r <= row(std::max(y0, y1)); r++) {
+                    for (size_t c = column(std::min(x0, x1)); c <= column(std::max(x0, x1)); c++) {
+                        marked[r * cols + c] = 1;
+                    }
+                }
+            }
+        }
+
+        /*
+         * true if the circumcircle of the counterclockwise triangle (a, b, c) holds no point
+         * and stays clear of marked cells; slivers are never clear
+         * points far from the circle are decided in double precision, the rest by the exact predicate
+         */
+        bool isClear(CDT::VertInd a, CDT::VertInd b, CDT::VertInd c) const {
+            const CDT::V2d<float>& A = points[a];
+            const CDT::V2d<float>& B = points[b];
+            const CDT::V2d<float>& C = points[c];
+            const double bx = B.x - A.x, by = B.y - A.y, b2 = bx * bx + by * by;
+            const double cx = C.x - A.x, cy = C.y - A.y, c2 = cx * cx + cy * cy;
+            const double d = 2.0 * (bx * cy - by * cx);
+            if (d <= 1e-3 * (b2 + c2)) {
+                return false;
+            }
+            const double ux = (cy * b2 - by * c2) / d;
+            const double uy = (bx * c2 - cx * b2) / d;
+            const double r2 = ux * ux + uy * uy;
+            const double r = sqrt(r2) * (1.0 + 1e-6);
+            const double ox = A.x + ux, oy = A.y + uy;
+
+            const size_t c0 = column(ox - r), c1 = column(ox + r);
+            const size_t r0 = row(oy - r), r1 = row(oy + r);
+            if ((c1 - c0 + 1) * (r1 - r0 + 1) > PARALLEL_CDT_MAX_DISK_CELLS) {
+                return false;
+            }
+            for (size_t y = r0; y <= r1; y++) {
+                for (size_t x = c0; x <= c1; x++) {
+                    const size_t index = y * cols + x;
+                    if (marked[index]) {
+                        return false;
+                    }
+                    for (uint32_t k = cellStart[index]; k < cellStart[index + 1]; k++) {
+                        const CDT::VertInd p = cellPoints[k];
+                        const double dx = points[p].x - ox, dy = points[p].y - oy;
+                        const double d2 = dx * dx + dy * dy;
+                        if (d2 > r2 * (1.0 + 1e-6) || p == a || p == b || p == c) {
+                            continue;
+                        }
+                        if (d2 < r2 * (1.0 - 1e-6) || CDT::isInCircumcircle(points[p], A, B, C)) {
+                            return false;
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+    };
+
+    /*
+     * triangulate the points of grid columns [firstColumn, lastColumn) and keep the triangles that are clear
+     */
+    static void triangulateStrip(const PointGrid& grid, size_t firstColumn, size_t lastColumn, Strip& strip,
+        std::vector<char>& inner) {
+        std::vector<CDT::VertInd> ids;    // strip vertex i is global vertex ids[i]
+        for (size_t r = 0; r < grid.rows; r++) {
+            ids.insert(ids.end(), grid.cellPoints.begin() + grid.cellStart[r * grid.cols + firstColumn],
+                grid.cellPoints.begin() + grid.cellStart[r * grid.cols + lastColumn]);
+        }
+        if (ids.size() < 3) {
+            return;
+        }
+        std::vector<CDT::V2d<float>> points;
+        points.reserve(ids.size());
+        for (CDT::VertInd v : ids) {
+            points.push_back(grid.points[v]);
+        }
+        CDT::Triangulation<float> cdt(CDT::VertexInsertionOrder::BRIO);
+        cdt.insertVertices(points);
+
+        // vertex i of the strip triangulation is ids[i - 3]; 0, 1 and 2 belong to its super-triangle
+        std::vector<CDT::TriInd> keptIndex(cdt.triangles.size(), CDT::noNeighbor);
+        CDT::TriInd kept = 0;
+        for (size_t iT = 0; iT < cdt.triangles.size(); iT++) {
+            const CDT::VerticesArr3& v = cdt.triangles[iT].vertices;
+            if (v[0] >= 3 && v[1] >= 3 && v[2] >= 3 && grid.isClear(ids[v[0] - 3], ids[v[1] - 3], ids[v[2] - 3])) {
+                keptIndex[iT] = kept++;
+            }
+        }
+
+        std::vector<char> onOutline(ids.size(), 0);
+        strip.kept.reserve(kept);
+        for (size_t iT = 0; iT < cdt.triangles.size(); iT++) {
+            if (keptIndex[iT] == CDT::noNeighbor) {
+                continue;
+            }
+            const CDT::Triangle& t = cdt.triangles[iT];
+            CDT::Triangle g;
+            for (CDT::Index i = 0; i < 3; i++) {
+                const CDT::VertInd v1 = t.vertices[i] - 3, v2 = t.vertices[CDT::ccw(i)] - 3;
+                g.vertices[i] = ids[v1];
+                g.neighbors[i] = t.neighbors[i] == CDT::noNeighbor ? CDT::noNeighbor : keptIndex[t.neighbors[i]];
+                if (g.neighbors[i] == CDT::noNeighbor) {
+                    strip.outline.push_back(CDT::Edge(ids[v1], ids[v2]));
+                    onOutline[v1] = onOutline[v2] = 1;
+                }
+            }
+            strip.kept.push_back(g);
+        }
+        for (const CDT::Triangle& t : strip.kept) {
+            for (CDT::Index i = 0; i < 3; i++) {
+                inner[t.vertices[i]] = 1;
+            }
+        }
+        for (size_t v = 0; v < ids.size(); v++) {
+            if (onOutline[v]) {
+                inner[ids[v]] = 0;
+            }
+        }
+    }
+
+    /*
+     * pair up the triangles on both sides of every edge still without a neighbor; what remains is the hull
+     */
+    static void linkAcrossOutline(CDT::TriangleVec& triangles) {
+        CDT::unordered_map<CDT::Edge, std::pair<CDT::TriInd, CDT::Index>> open;
+        for (size_t iT = 0; iT < triangles.size(); iT++) {
+            CDT::Triangle& t = triangles[iT];
+            for (CDT::Index i = 0; i < 3; i++) {
+                if (t.neighbors[i] != CDT::noNeighbor) {
+                    continue;
+                }
+                const CDT::Edge e(t.vertices[i], t.vertices[CDT::ccw(i)]);
+                auto it = open.find(e);
+                if (it == open.end()) {
+                    open.insert(std::make_pair(e, std::make_pair(CDT::TriInd(iT), i)));
+                    continue;
+                }
+                t.neighbors[i] = it->second.first;
+                triangles[it->second.first].neighbors[it->second.second] = CDT::TriInd(iT);
+                open.erase(it);
+            }
+        }
+    }
+
+    /*
+     * depth-peeling that starts outside the hull: triangles on the hull are at depth 0,
+     * or 1 if their hull edge is a constraint; triangles at even depth are erased
+     * same layers as CDT::CalculateTriangleDepths, but only edges between two constraint vertices are looked up
+     */
+    static void eraseOuterTrianglesAndHoles(CDT::TriangleVec& triangles, const CDT::EdgeUSet& fixedEdges, size_t vertexCount) {
+        std::vector<char> onConstraint(vertexCount, 0);
+        for (const CDT::Edge& e : fixedEdges) {
+            onConstraint[e.v1()] = onConstraint[e.v2()] = 1;
+        }
+        auto isFixed = [&](const CDT::Triangle& t, CDT::Index i) {
+            const CDT::VertInd a = t.vertices[i], b = t.vertices[CDT::ccw(i)];
+            return onConstraint[a] && onConstraint[b] && fixedEdges.count(CDT::Edge(a, b)) > 0;
+        };
+
+        const CDT::LayerDepth unset = std::numeric_limits<CDT::LayerDepth>::max();
+        std::vector<CDT::LayerDepth> depths(triangles.size(), unset);
+        std::vector<CDT::TriInd> seeds, behind;
+        for (size_t iT = 0; iT < triangles.size(); iT++) {
+            for (CDT::Index i = 0; i < 3; i++) {
+                if (triangles[iT].neighbors[i] == CDT::noNeighbor) {
+                    (isFixed(triangles[iT], i) ? behind : seeds).push_back(CDT::TriInd(iT));
+                }
+            }
+        }
+        // layer 0 may be empty if the whole hull is constrained
+        for (CDT::LayerDepth layer = 0; layer == 0 || !seeds.empty(); layer++) {
+            std::vector<CDT::TriInd> stack;
+            stack.swap(seeds);
+            while (!stack.empty()) {
+                const CDT::TriInd iT = stack.back();
+                stack.pop_back();
+                if (depths[iT] != unset) {
+                    continue;
+                }
+                depths[iT] = layer;
+                for (CDT::Index i = 0; i < 3; i++) {
+                    const CDT::TriInd iN = triangles[iT].neighbors[i];
+                    if (iN != CDT::noNeighbor && depths[iN] == unset) {
+                        (isFixed(triangles[iT], i) ? behind : stack).push_back(iN);
+                    }
+                }
+            }
+            for (CDT::TriInd iT : behind) {
+                if (depths[iT] == unset) {
+                    seeds.push_back(iT);
+                }
+            }
+            behind.clear();
+        }
+
+        std::vector<CDT::TriInd> newIndex(triangles.size(), CDT::noNeighbor);
+        size_t kept = 0;
+        for (size_t iT = 0; iT < triangles.size(); iT++) {
+            if (depths[iT] != unset && depths[iT] % 2 == 1) {
+                newIndex[iT] = CDT::TriInd(kept);
+                triangles[kept++] = triangles[iT];
+            }
+        }
+        triangles.resize(kept);
+        for (CDT::Triangle& t : triangles) {
+            for (CDT::Index i = 0; i < 3; i++) {
+                if (t.neighbors[i] != CDT::noNeighbor) {
+                    t.neighbors[i] = newIndex[t.neighbors[i]];
+                }
+            }
+        }
+    }
+};
+
+#endif
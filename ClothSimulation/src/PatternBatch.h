@@ -0,0 +1,204 @@
+#ifndef PATTERN_BATCH_H
+#define PATTERN_BATCH_H
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ClothCreator.h"
+#include "ThreadPool.h"
+
+// Defaults
+const size_t BATCH_MEMORY_BUDGET = size_t(1) << 30;     // bytes that files in flight may use together
+const size_t BATCH_BYTES_PER_SOURCE_BYTE = 64;          // rough peak footprint of meshing a file, relative to its size
+
+struct BatchResult
+{
+    std::string path;
+    bool ok = false;
+    bool cached = false;        // up-to-date cache, nothing was meshed
+    std::string error;
+    size_t sourceBytes = 0;
+    size_t panels = 0;
+    size_t nodes = 0;
+    size_t springs = 0;
+    size_t triangles = 0;
+    double seconds = 0.0;
+};
+
+/*
+ * mesh many pattern files into the cloth cache, one pool task per file
+ * a file starts only while the estimated footprint of everything in flight fits 'memoryBudget';
+ * a file estimated above the whole budget runs on its own
+ */
+class PatternBatch
+{
+public:
+    float meshStep = STEP;
+    Mesh_Mode meshMode = MESH_BOUNDING_BOX;
+    float targetEdgeLength = 0.0f;
+    float clearance = CONFORMING_CLEARANCE;
+    float minAngle = CONFORMING_MIN_ANGLE;
+    std::string cacheDir;
+    size_t memoryBudget = BATCH_MEMORY_BUDGET;
+    std::vector<BatchResult> results;
+
+    /*
+     * every .dxf below a directory, or the files listed in a manifest
+     * manifest: one path per line, relative to the manifest's folder; blank lines and lines starting with '#' are skipped
+     */
+    static std::vector<std::string> listFiles(const std::string& source) {
+        namespace fs = std::filesystem;
+        std::vector<std::string> files;
+        std::error_code ec;
+        if (fs::is_directory(source, ec)) {
+            for (fs::recursive_directory_iterator it(source, ec), end; !ec && it != end; it.increment(ec)) {
+                std::string ext = it->path().extension().string();
+                std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+                if (ext == ".dxf" && it->is_regular_file(ec)) {
+                    files.push_back(it->path().string());
+                }
+            }
+            std::sort(files.begin(), files.end());
+        }
+        else {
+            std::ifstream manifest(source);
+            if (!manifest) {
+                std::cerr << source << " could not be opened.\n";
+            }
+            fs::path base = fs::path(source).parent_path();
+            std::string line;
+            while (std::getline(manifest, line)) {
+                size_t first = line.find_first_not_of(" \t\r");
+                size_t last = line.find_last_not_of(" \t\r");
+                if (first == std::string::npos || line[first] == '#') {
+                    continue;
+                }
+                fs::path file(line.substr(first, last - first + 1));
+                files.push_back((file.is_relative() ? base / file : file).string());
+            }
+        }
+        return files;
+    }
+
+    /*
+     * returns true if every file was meshed (or already cached) and its cache written
+     */
+    bool run(const std::vector<std::string>& files) {
+        auto start = std::chrono::steady_clock::now();
+        results.assign(files.size(), BatchResult());
+        inFlight = 0;
+
+        threadPool().parallelFor(files.size(), [&](size_t i) {
+            results[i] = process(files[i]);
+            report(results[i]);
+        });
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        size_t ok = 0, cached = 0, bytes = 0, panels = 0, nodes = 0;
+        for (const BatchResult& r : results) {
+            ok += r.ok;
+            cached += r.cached;
+            bytes += r.sourceBytes;
+            panels += r.panels;
+            nodes += r.nodes;
+        }
+        double mb = bytes / 1048576.0;
+        printf("batch: %zu files, %zu ok (%zu cached), %zu failed, %.1f MB in %.2f s: %.1f files/s, %.2f MB/s, %.0f nodes/s\n",
+            results.size(), ok, cached, results.size() - ok, mb, seconds,
+            results.size() / std::max(seconds, 1e-9), mb / std::max(seconds, 1e-9), nodes / std::max(seconds, 1e-9));
+        for (const BatchResult& r : results) {
+            if (!r.ok) {
+                printf("  failed: %s: %s\n", r.path.c_str(), r.error.c_str());
+            }
+        }
+        return ok == results.size();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable released;
+    size_t inFlight;    // estimated bytes of the files being processed
+
+    BatchResult process(const std::string& file) {
+        BatchResult r;
+        r.path = file;
+        std::error_code ec;
+        uintmax_t size = std::filesystem::file_size(file, ec);
+        if (ec) {
+            r.error = "could not be opened";
+            return r;
+        }
+        r.sourceBytes = size_t(size);
+
+        const size_t footprint = std::max<size_t>(r.sourceBytes, 1) * BATCH_BYTES_PER_SOURCE_BYTE;
+        acquire(footprint);
+        auto start = std::chrono::steady_clock::now();
+        try {
+            ClothCreator creator(meshStep, meshMode);
+            creator.targetEdgeLength = targetEdgeLength;
+            creator.clearance = clearance;
+            creator.minAngle = minAngle;
+            creator.cacheDir = cacheDir;
+            creator.verbose = false;
+            if (!creator.load(file)) {
+                r.error = "could not be opened";
+            }
+            else if (!cacheDir.empty() && !creator.cacheHit && !creator.cacheSaved) {
+                r.error = "cache could not be written";
+            }
+            else {
+                r.ok = true;
+                r.cached = creator.cacheHit;
+            }
+            r.panels = creator.cloths.size();
+            for (Cloth* c : creator.cloths) {
+                r.nodes += c->nodes.size();
+                r.springs += c->springs.size();
+                r.triangles += c->faces.size() / 3;
+            }
+        }
+        catch (const std::exception& e) {
+            r.ok = false;
+            r.error = e.what();
+        }
+        r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        release(footprint);
+        return r;
+    }
+
+    void acquire(size_t bytes) {
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [&] { return inFlight == 0 || inFlight + bytes <= memoryBudget; });
+        inFlight += bytes;
+    }
+
+    void release(size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inFlight -= bytes;
+        }
+        released.notify_all();
+    }
+
+    void report(const BatchResult& r) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (r.ok) {
+            printf("%s: %zu panels, %zu nodes, %zu springs, %zu triangles, %.1f ms, %.2f MB/s%s\n",
+                r.path.c_str(), r.panels, r.nodes, r.springs, r.triangles, r.seconds * 1000.0,
+                r.sourceBytes / 1048576.0 / std::max(r.seconds, 1e-9), r.cached ? " (cached)" : "");
+        }
+        else {
+            printf("%s: failed: %s\n", r.path.c_str(), r.error.c_str());
+        }
+    }
+};
+
+#endif
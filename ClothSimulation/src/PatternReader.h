@@ -0,0 +1,348 @@
+#ifndef PATTERN_READER_H
+#define PATTERN_READER_H
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <assert.h>
+#include <glm/glm.hpp>
+#include <dxf/dl_creationadapter.h>
+
+#include "test_creationclass.h"     // point2D
+
+// Defaults
+const double CHORD_TOLERANCE = 0.1;     // largest gap between a curve and its tessellation, in segment lengths
+const int MAX_CURVE_DEPTH = 12;         // subdivision limit per spline knot span
+const int MAX_CURVE_SEGMENTS = 4096;    // per bulge arc
+const int MAX_INSERT_DEPTH = 8;         // blocks nested deeper than this are not placed
+
+/*
+ * dxf adapter that turns pattern pieces into closed contours
+ * every contour is handed to 'onContour' as soon as its entity ends, so pieces can be meshed while the rest of the file is parsed
+ * POLYLINE and LWPOLYLINE bulge arcs and SPLINE curves are tessellated adaptively:
+ * edges are at most 'segmentLengthOf(piece)' long and stay within CHORD_TOLERANCE of the curve
+ */
+class PatternReader : public DL_CreationAdapter
+{
+public:
+    std::function<void(std::vector<point2D>&&)> onContour;
+    std::function<float(size_t)> segmentLengthOf;   // longest tessellated edge of the piece with the given index
+    // pattern CAD exports draw every piece as a block in sheet coordinates and insert it at a label anchor;
+    // when false such blocks are taken as drawn and INSERT is ignored,
+    // when true block contours are only emitted through INSERT, with its placement, scale, rotation and array applied
+    bool placeInserts = false;
+    size_t contourCount = 0;
+
+    virtual void addBlock(const DL_BlockData& data) {
+        currentBlock = data.name;
+        if (placeInserts) {
+            Block& block = blocks[currentBlock];
+            block.base = glm::dvec2(data.bpx, data.bpy);
+            block.contours.clear();
+            block.inserts.clear();
+        }
+    }
+
+    virtual void endBlock() {
+        currentBlock.clear();
+    }
+
+    virtual void addPolyline(const DL_PolylineData& data) {
+        // a pattern piece is always closed; the flag only decides whether the last vertex' bulge bends the closing edge
+        shape = SHAPE_POLYLINE;
+        closed = (data.flags & 1) != 0;
+        vertices.clear();
+    }
+
+    virtual void addVertex(const DL_VertexData& data) {
+        if (shape == SHAPE_POLYLINE) {
+            vertices.push_back(glm::dvec3(data.x, data.y, data.bulge));
+        }
+    }
+
+    virtual void addSpline(const DL_SplineData& data) {
+        shape = SHAPE_SPLINE;
+        closed = (data.flags & 3) != 0;   // closed or periodic
+        degree = data.degree;
+        controls.clear();
+        knots.clear();
+        fits.clear();
+    }
+
+    virtual void addControlPoint(const DL_ControlPointData& data) {
+        controls.push_back(glm::dvec3(data.x, data.y, data.w > 0.0 ? data.w : 1.0));
+    }
+
+    virtual void addKnot(const DL_KnotData& data) {
+        knots.push_back(data.k);
+    }
+
+    virtual void addFitPoint(const DL_FitPointData& data) {
+        fits.push_back(glm::dvec2(data.x, data.y));
+    }
+
+    virtual void addInsert(const DL_InsertData& data) {
+        if (!placeInserts) {
+            return;
+        }
+        if (!currentBlock.empty()) {
+            blocks[currentBlock].inserts.push_back(data);
+        }
+        else {
+            placeBlock(data, Placement(), 0);
+        }
+    }
+
+    virtual void endEntity() {
+        if (shape == SHAPE_POLYLINE) {
+            finishContour(tessellatePolyline());
+        }
+        else if (shape == SHAPE_SPLINE) {
+            std::vector<glm::dvec2> contour = tessellateSpline();
+            if (closed || (contour.size() > 2 && glm::length(contour.front() - contour.back()) < 1e-9)) {
+                finishContour(contour);
+            }
+        }
+        shape = SHAPE_NONE;
+    }
+
+    virtual void endSequence() {
+        // POLYLINE without vertices never gets an endEntity
+        shape = SHAPE_NONE;
+    }
+
+private:
+    enum Shape_State { SHAPE_NONE, SHAPE_POLYLINE, SHAPE_SPLINE };
+
+    /*
+     * 2d affine map p -> m * p + t
+     */
+    struct Placement
+    {
+        glm::dmat2 m = glm::dmat2(1.0);
+        glm::dvec2 t = glm::dvec2(0.0);
+
+        glm::dvec2 apply(const glm::dvec2& p) const { return m * p + t; }
+        Placement then(const Placement& inner) const {
+            Placement p;
+            p.m = m * inner.m;
+            p.t = m * inner.t + t;
+            return p;
+        }
+    };
+
+    struct Block
+    {
+        glm::dvec2 base = glm::dvec2(0.0);
+        std::vector<std::vector<glm::dvec2>> contours;  // in block coordinates
+        std::vector<DL_InsertData> inserts;             // nested blocks
+    };
+
+    Shape_State shape = SHAPE_NONE;
+    bool closed = false;
+    std::vector<glm::dvec3> vertices;   // x, y, bulge
+    unsigned int degree = 3;
+    std::vector<glm::dvec3> controls;   // x, y, weight
+    std::vector<double> knots;
+    std::vector<glm::dvec2> fits;
+
+    std::string currentBlock;
+    std::map<std::string, Block> blocks;
+
+    void finishContour(const std::vector<glm::dvec2>& contour) {
+        if (contour.size() < 3) {
+            return;
+        }
+        if (placeInserts && !currentBlock.empty()) {
+            blocks[currentBlock].contours.push_back(contour);
+        }
+        else {
+            emit(contour, nullptr);
+        }
+    }
+
+    void emit(const std::vector<glm::dvec2>& contour, const Placement* placement) {
+        std::vector<point2D> points;
+        points.reserve(contour.size());
+        for (const glm::dvec2& p : contour) {
+            glm::dvec2 q = placement ? placement->apply(p) : p;
+            points.push_back(point2D(float(q.x), float(q.y)));
+        }
+        contourCount += 1;
+        if (onContour) {
+            onContour(std::move(points));
+        }
+    }
+
+    /*
+     * instantiate a block: array offsets run along the rotated insert axes, scale applies to block coordinates
+     */
+    void placeBlock(const DL_InsertData& insert, const Placement& parent, int depth) {
+        auto it = blocks.find(insert.name);
+        if (it == blocks.end() || depth > MAX_INSERT_DEPTH) {
+            return;
+        }
+        const Block& block = it->second;
+
+        const double angle = glm::radians(insert.angle);
+        const double c = cos(angle), s = sin(angle);
+        Placement rotate;
+        rotate.m = glm::dmat2(c, s, -s, c);
+        rotate.t = glm::dvec2(insert.ipx, insert.ipy);
+        Placement scale;
+        scale.m = glm::dmat2(insert.sx, 0.0, 0.0, insert.sy);
+        scale.t = -glm::dvec2(insert.sx, insert.sy) * block.base;
+
+        for (int row = 0; row < std::max(1, insert.rows); row++) {
+            for (int col = 0; col < std::max(1, insert.cols); col++) {
+                Placement offset;
+                offset.t = glm::dvec2(col * insert.colSp, row * insert.rowSp);
+                Placement placement = parent.then(rotate).then(offset).then(scale);
+
+                for (const std::vector<glm::dvec2>& contour : block.contours) {
+                    emit(contour, &placement);
+                }
+                for (const DL_InsertData& nested : block.inserts) {
+                    placeBlock(nested, placement, depth + 1);
+                }
+            }
+        }
+    }
+
+    void tolerances(double& maxLength, double& tolerance) const {
+        assert(segmentLengthOf);
+        maxLength = segmentLengthOf(contourCount);
+        tolerance = CHORD_TOLERANCE * maxLength;
+    }
+
+    std::vector<glm::dvec2> tessellatePolyline() const {
+        double maxLength, tolerance;
+        tolerances(maxLength, tolerance);
+
+        std::vector<glm::dvec2> contour;
+        for (size_t i = 0, v_sz = vertices.size(); i < v_sz; i++) {
+            glm::dvec2 p0(vertices[i]);
+            contour.push_back(p0);
+            if (i + 1 < v_sz) {
+                addArc(contour, p0, glm::dvec2(vertices[i + 1]), vertices[i].z, maxLength, tolerance);
+            }
+            else if (closed) {
+                addArc(contour, p0, glm::dvec2(vertices[0]), vertices[i].z, maxLength, tolerance);
+            }
+        }
+        return contour;
+    }
+
+    /*
+     * append the points strictly between p0 and p1 on the arc given by the bulge (tan of a quarter of the included angle)
+     */
+    static void addArc(std::vector<glm::dvec2>& contour, const glm::dvec2& p0, const glm::dvec2& p1, double bulge,
+        double maxLength, double tolerance) {
+        const double chord = glm::length(p1 - p0);
+        if (fabs(bulge) < 1e-9 || chord < 1e-12) {
+            return;
+        }
+        const double theta = 4.0 * atan(bulge);     // positive is counter-clockwise
+        const double radius = chord / (2.0 * fabs(sin(theta / 2.0)));
+        const glm::dvec2 dir = (p1 - p0) / chord;
+        const glm::dvec2 center = (p0 + p1) / 2.0 + glm::dvec2(-dir.y, dir.x) * (chord / 2.0 / tan(theta / 2.0));
+
+        // enough segments for both the length limit and the sagitta limit
+        double n = fabs(theta) * radius / std::max(maxLength, 1e-12);
+        if (tolerance < radius) {
+            n = std::max(n, fabs(theta) / (2.0 * acos(1.0 - tolerance / radius)));
+        }
+        const int segments = std::min(MAX_CURVE_SEGMENTS, std::max(1, int(ceil(n))));
+
+        const double start = atan2(p0.y - center.y, p0.x - center.x);
+        for (int k = 1; k < segments; k++) {
+            double a = start + theta * k / segments;
+            contour.push_back(center + radius * glm::dvec2(cos(a), sin(a)));
+        }
+    }
+
+    std::vector<glm::dvec2> tessellateSpline() const {
+        std::vector<glm::dvec2> contour;
+        const size_t n = controls.size();
+        if (degree < 1 || n <= degree || knots.size() != n + degree + 1) {
+            // no usable NURBS definition: fall back to the fit points, or the control polygon
+            if (fits.size() >= 2) {
+                contour = fits;
+            }
+            else {
+                for (const glm::dvec3& c : controls) {
+                    contour.push_back(glm::dvec2(c));
+                }
+            }
+            return contour;
+        }
+
+        double maxLength, tolerance;
+        tolerances(maxLength, tolerance);
+
+        contour.push_back(evaluate(knots[degree]));
+        for (size_t k = degree; k < n; k++) {
+            if (knots[k + 1] > knots[k]) {
+                subdivide(contour, knots[k], contour.back(), knots[k + 1], evaluate(knots[k + 1]), maxLength, tolerance, 0);
+            }
+        }
+        if (contour.size() > 1 && glm::length(contour.front() - contour.back()) < 1e-9) {
+            contour.pop_back();
+        }
+        return contour;
+    }
+
+    /*
+     * append the points after p0 up to and including p1
+     */
+    void subdivide(std::vector<glm::dvec2>& contour, double u0, glm::dvec2 p0, double u1, glm::dvec2 p1,
+        double maxLength, double tolerance, int depth) const {
+        const double um = (u0 + u1) / 2.0;
+        const glm::dvec2 pm = evaluate(um);
+        if (depth < MAX_CURVE_DEPTH && (glm::length(p1 - p0) > maxLength || distanceToSegment(pm, p0, p1) > tolerance)) {
+            subdivide(contour, u0, p0, um, pm, maxLength, tolerance, depth + 1);
+            subdivide(contour, um, pm, u1, p1, maxLength, tolerance, depth + 1);
+        }
+        else {
+            contour.push_back(p1);
+        }
+    }
+
+    /*
+     * de Boor's algorithm on homogeneous control points
+     */
+    glm::dvec2 evaluate(double u) const {
+        const size_t n = controls.size();
+        const size_t p = degree;
+        size_t k = p;
+        while (k + 1 < n && u >= knots[k + 1]) {
+            k++;
+        }
+
+        std::vector<glm::dvec3> d(p + 1);
+        for (size_t j = 0; j <= p; j++) {
+            const glm::dvec3& c = controls[j + k - p];
+            d[j] = glm::dvec3(c.x * c.z, c.y * c.z, c.z);
+        }
+        for (size_t r = 1; r <= p; r++) {
+            for (size_t j = p; j >= r; j--) {
+                double den = knots[j + 1 + k - r] - knots[j + k - p];
+                double alpha = den > 0.0 ? (u - knots[j + k - p]) / den : 0.0;
+                d[j] = (1.0 - alpha) * d[j - 1] + alpha * d[j];
+            }
+        }
+        return glm::dvec2(d[p].x / d[p].z, d[p].y / d[p].z);
+    }
+
+    static double distanceToSegment(const glm::dvec2& p, const glm::dvec2& a, const glm::dvec2& b) {
+        glm::dvec2 ab = b - a;
+        double len2 = glm::dot(ab, ab);
+        double t = len2 > 0.0 ? glm::clamp(glm::dot(p - a, ab) / len2, 0.0, 1.0) : 0.0;
+        return glm::length(p - (a + t * ab));
+    }
+};
+
+#endif
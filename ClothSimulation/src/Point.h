@@ -31,6 +31,7 @@ public:
     int         segmentID;      // ƬԵΪܶ, õĶ ID; ǱԵϵĵΪ -1
     int         meshId;         // õ meshId = -1, ֶѰҸõΧĵ, Ӷڵ֮ɵ
     int         globalID;       // ڲײļ
+    int         localID;        // index in Cloth::nodes
     bool        isSewed;        // жϸõǷѷ
     bool        isSelected;     // жǷѾѡΪϵ
     bool        isTurningPoint; // жϸõǷΪϵת۵
@@ -53,7 +54,6 @@ public:
         localPosition = glm::vec3(x, y, z);
         init();
     }
-    ~Node() {}
 
     void addForce(const glm::vec3& force)
     {
@@ -87,8 +87,10 @@ private:
         segmentID = -1; // ĬϲǱԵϵĵ
         meshId = -1;
         globalID = -1;
+        localID = -1;
         isSewed = false;
         isSelected = false;
+        isTurningPoint = false;
         worldPosition = glm::vec3(0);
         lastWorldPosition = glm::vec3(0);
         velocity = glm::vec3(0);
@@ -0,0 +1,205 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+
+#include "ClothCreator.h"
+#include "ClothMultigrid.h"
+#include "ClothSewMachine.h"
+#include "Material.h"
+#include "SeamSpec.h"
+#include "ThreadPool.h"
+
+// Defaults
+const int MAX_SUBSTEPS = 8;         // most substeps step() splits a time step into for stiff or light materials
+
+/*
+ * one drape: the cloths of a pattern, their seams, the body they fall on and the counters of cloth and node IDs
+ * scenes share nothing that a step writes, so independent drapes can be stepped concurrently, see stepAll()
+ * the body is only read while stepping and may be shared by any number of scenes
+ */
+class Scene
+{
+public:
+    IdCounters ids;
+    ClothCreator creator;
+    std::vector<Cloth*>& cloths;        // owned by the creator
+    ClothSewMachine sewMachine;
+    const ModelRender* body;            // not owned; nullptr lets the cloths fall freely
+    bool recordChecksums = false;       // keep checksum() after every step, to compare runs bit for bit
+    std::vector<uint64_t> checksums;
+
+    /*
+     * 'camera' is only needed to draw the sewing lines of picked segments
+     */
+    Scene(Camera* camera = nullptr, float meshStep = STEP, Mesh_Mode mode = MESH_BOUNDING_BOX)
+        : creator(meshStep, mode), cloths(creator.cloths), sewMachine(camera), body(nullptr)
+    {
+        creator.ids = &ids;
+    }
+
+    ~Scene()
+    {
+        for (size_t i = 0; i < solvers.size(); i++) {
+            delete solvers[i];
+            delete hierarchies[i];
+        }
+    }
+
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    /*
+     * mesh a pattern file, give its panels the materials of a library file and sew the seams of a spec file, if given
+     * returns false if a file could not be read; seams naming missing panels or segments are skipped
+     */
+    bool load(const std::string& patternFile, const std::string& seamFile = "", const std::string& materialFile = "")
+    {
+        if (!creator.load(patternFile)) {
+            return false;
+        }
+        if (!materialFile.empty()) {
+            MaterialLibrary library;
+            if (!library.load(materialFile)) {
+                return false;
+            }
+            for (int i = 0; i < int(cloths.size()); i++) {
+                if (const Material* material = library.forPanel(i)) {
+                    cloths[i]->applyMaterial(*material);
+                }
+            }
+        }
+        if (!seamFile.empty()) {
+            SeamSpec spec;
+            if (!spec.load(seamFile)) {
+                return false;
+            }
+            std::cout << "Sewed " << sewMachine.sew(spec, cloths) << " of " << spec.seams.size() << " seams." << std::endl;
+        }
+        return true;
+    }
+
+    /*
+     * integrate every cloth implicitly with a MultigridSolver over 'levels' coarser meshes of its panel,
+     * each with twice the step of the next finer one; call after load()
+     * the solver rebuilds its operators when Cloth::revision or the time step changes
+     */
+    void enableMultigrid(int levels)
+    {
+        for (size_t i = 0; i < cloths.size(); i++) {
+            std::vector<float> steps;
+            for (int l = 1; l <= levels; l++) {
+                steps.push_back(creator.stepOfPanel(i) * float(1 << l));
+            }
+            hierarchies.push_back(creator.createHierarchy(i, steps, cloths[i]));
+            solvers.push_back(new MultigridSolver(hierarchies.back()));
+            cloths[i]->solver = solvers.back();
+        }
+    }
+
+    /*
+     * one time step, split into as many substeps as the stiffest and lightest material needs to stay stable
+     */
+    void step(float timeStep)
+    {
+        const int substeps = substepsFor(timeStep);
+        for (int i = 0; i < substeps; i++) {
+            substep(timeStep / float(substeps));
+        }
+        // steps against the body, not substeps, so a cloth rests after the same time whatever its material
+        for (Cloth* cloth : cloths) {
+            if (cloth->isActive() && cloth->isSewed && body != nullptr) {
+                cloth->collisionCount += 1;
+            }
+        }
+        if (recordChecksums) {
+            checksums.push_back(checksum());
+        }
+    }
+
+    /*
+     * substeps of length timeStep / n that stay within Cloth::stableTimeStep of every active, explicitly integrated cloth
+     * (at most MAX_SUBSTEPS); seams are not taken into account
+     */
+    int substepsFor(float timeStep) const
+    {
+        float stable = FLT_MAX;
+        for (const Cloth* cloth : cloths) {
+            if (cloth->isActive() && cloth->solver == nullptr) {
+                stable = std::min(stable, cloth->stableTimeStep);
+            }
+        }
+        return timeStep <= stable ? 1 : std::min(MAX_SUBSTEPS, int(ceilf(timeStep / stable)));
+    }
+
+    /*
+     * forces of all cloths and seams first, so every node is integrated once per substep
+     */
+    void substep(float timeStep)
+    {
+        for (Cloth* cloth : cloths) {
+            if (cloth->isActive()) {
+                cloth->computeForces(timeStep);
+            }
+        }
+        sewMachine.addForces();
+        for (Cloth* cloth : cloths) {
+            if (cloth->isActive()) {
+                cloth->integrate(timeStep);
+                cloth->strainLimit();
+                if (cloth->isSewed && body != nullptr) {
+                    cloth->modelCollision(*body);
+                }
+            }
+        }
+        sewMachine.constrain();
+    }
+
+    /*
+     * hash of the bits of every node position, cloths and nodes in order
+     * forces are summed in a fixed order, so it does not depend on the number of threads
+     */
+    uint64_t checksum() const
+    {
+        uint64_t h = FNV_OFFSET;
+        for (const Cloth* cloth : cloths) {
+            for (const Node* n : cloth->nodes) {
+                h = FileCache::hash(&n->worldPosition, sizeof(n->worldPosition), h);
+            }
+        }
+        return h;
+    }
+
+    /*
+     * false once every cloth has come to rest on the body
+     */
+    bool isActive() const
+    {
+        for (const Cloth* cloth : cloths) {
+            if (cloth->isActive()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * 'steps' time steps of every scene, one pool task per scene
+     * work inside a scene runs serially then, the pool does not nest
+     */
+    static void stepAll(const std::vector<Scene*>& scenes, int steps, float timeStep)
+    {
+        threadPool().parallelFor(scenes.size(), [&](size_t i) {
+            for (int s = 0; s < steps && scenes[i]->isActive(); s++) {
+                scenes[i]->step(timeStep);
+            }
+        });
+    }
+
+private:
+    std::vector<ClothHierarchy*> hierarchies;      // one per cloth once enableMultigrid() was called
+    std::vector<MultigridSolver*> solvers;
+};
+
+#endif
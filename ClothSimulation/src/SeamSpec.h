@@ -0,0 +1,70 @@
+#ifndef SEAM_SPEC_H
+#define SEAM_SPEC_H
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * one seam: segment 'segment' of panel 'panel' is sewed to segment 'partnerSegment' of panel 'partner'
+ * panels are numbered in the order of the pattern file from 0, segments in the order of Cloth::segments
+ */
+struct SeamEntry
+{
+    int panel;
+    int segment;
+    int partner;
+    int partnerSegment;
+    bool reversed;      // the partner segment runs the other way, so its last node meets the first node of 'segment'
+};
+
+/*
+ * declarative list of the seams of a garment, so it can be sewed without picking segments by hand
+ * one seam per line: <panel> <segment> <partner> <partner segment> [forward|reverse]
+ * blank lines and lines starting with '#' are skipped; the direction defaults to forward
+ */
+class SeamSpec
+{
+public:
+    std::vector<SeamEntry> seams;
+
+    /*
+     * returns false if the file could not be opened or a line is malformed; nothing is kept in that case
+     */
+    bool load(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) {
+            std::cout << "[SeamSpec] " << path << " could not be opened." << std::endl;
+            return false;
+        }
+        std::vector<SeamEntry> entries;
+        std::string line;
+        for (int lineNumber = 1; std::getline(in, line); lineNumber++) {
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#') {
+                continue;
+            }
+            std::istringstream fields(line);
+            SeamEntry entry;
+            std::string direction = "forward", rest;
+            fields >> entry.panel >> entry.segment >> entry.partner >> entry.partnerSegment;
+            bool ok = bool(fields) && entry.panel >= 0 && entry.segment >= 0 && entry.partner >= 0 && entry.partnerSegment >= 0;
+            if (ok && !(fields >> direction)) {
+                direction = "forward";
+            }
+            ok = ok && (direction == "forward" || direction == "reverse") && !(fields >> rest);
+            if (!ok) {
+                std::cout << "[SeamSpec] " << path << ":" << lineNumber << " is not a seam: " << line << std::endl;
+                return false;
+            }
+            entry.reversed = direction == "reverse";
+            entries.push_back(entry);
+        }
+        seams = std::move(entries);
+        return true;
+    }
+};
+
+#endif
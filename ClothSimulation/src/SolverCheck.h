@@ -0,0 +1,88 @@
+#ifndef SOLVER_CHECK_H
+#define SOLVER_CHECK_H
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "ClothCreator.h"
+#include "ClothMultigrid.h"
+
+// Defaults
+const int CHECK_LEVELS = 2;                 // coarse levels below every panel
+const float CHECK_TIME_STEP = 0.01f;
+const int CHECK_MAX_ITERATIONS = 2000;
+
+/*
+ * reproducible check of MultigridSolver: the system of every panel of a pattern is solved for the same fixed
+ * right hand side, once with the multigrid V-cycle as preconditioner and once with a single level
+ * (one symmetric Gauss-Seidel sweep), and the PCG iterations of both are printed
+ *   ClothSimulation --solver-check <pattern> [levels] [time step]
+ */
+class SolverCheck
+{
+public:
+    int levels = CHECK_LEVELS;
+    float timeStep = CHECK_TIME_STEP;
+    float meshStep = STEP;
+
+    /*
+     * false if the pattern could not be read or a solve did not reach the tolerance
+     */
+    bool run(const std::string& patternFile) {
+        ClothCreator creator(meshStep);
+        creator.verbose = false;
+        if (!creator.load(patternFile)) {
+            return false;
+        }
+        bool converged = true;
+        for (size_t i = 0; i < creator.cloths.size(); i++) {
+            Cloth* cloth = creator.cloths[i];
+            std::vector<float> steps;
+            for (int l = 1; l <= levels; l++) {
+                steps.push_back(creator.stepOfPanel(i) * float(1 << l));
+            }
+            ClothHierarchy* multi = creator.createHierarchy(i, steps, cloth);
+            ClothHierarchy* single = creator.createHierarchy(i, {}, cloth);
+
+            std::vector<glm::vec3> b(cloth->nodes.size());
+            for (size_t k = 0; k < b.size(); k++) {
+                // smooth over the panel plus a little noise, the smooth part is what single level methods are slow at
+                const glm::vec3 p = cloth->nodes[k]->localPosition;
+                b[k] = timeStep * glm::vec3(sinf(p.x * 0.01f), cosf(p.y * 0.013f), sinf((p.x + p.y) * 0.007f) + 0.1f * sinf(float(k)));
+            }
+            Result m = solve(multi, b, MG_COARSE_STEPS);
+            Result s = solve(single, b, 1);
+            printf("panel %zu: %zu nodes, multigrid %d iterations (%.2e, %.1f ms), single level %d iterations (%.2e, %.1f ms)\n",
+                i, cloth->nodes.size(), m.iterations, m.residual, m.seconds * 1000.0, s.iterations, s.residual, s.seconds * 1000.0);
+            converged = converged && m.residual < MG_TOLERANCE && s.residual < MG_TOLERANCE;
+            delete multi;
+            delete single;
+        }
+        return converged;
+    }
+
+private:
+    struct Result
+    {
+        int iterations;
+        float residual;
+        double seconds;
+    };
+
+    Result solve(ClothHierarchy* hierarchy, const std::vector<glm::vec3>& b, int coarseSteps) const {
+        MultigridSolver solver(hierarchy);
+        solver.maxIterations = CHECK_MAX_ITERATIONS;
+        solver.coarseSteps = coarseSteps;
+        const auto start = std::chrono::steady_clock::now();
+        solver.prepare(timeStep);
+        std::vector<glm::vec3> x(b.size(), glm::vec3(0.0f));
+        solver.solve(b, x);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return Result{ solver.lastIterations, solver.lastResidual, seconds };
+    }
+};
+
+#endif
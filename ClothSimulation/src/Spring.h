@@ -1,6 +1,7 @@
 #ifndef SPRING_H
 #define SPRING_H
 
+#include "Material.h"
 #include "Point.h"
 
 class Spring
@@ -17,7 +18,7 @@ public:
         node1 = n1;
         node2 = n2;
         hookCoef = hookCoefficient;
-        dampCoef = 2;
+        dampCoef = SPRING_DAMPING;
         restLength = glm::distance(node1->worldPosition, node2->worldPosition);
     }
 
@@ -29,28 +30,56 @@ public:
      */
     void computeInternalForce(float timeStep)
     {
-        float currentLength = glm::distance(node1->worldPosition, node2->worldPosition);
+        glm::vec3 force = internalForce();
+        node1->addForce(force);
+        node2->addForce(-force);
+    }
+
+    /*
+     * force on node1 (node2 gets the opposite one), without applying it
+     */
+    glm::vec3 internalForce() const
+    {
+        return force(node1->worldPosition, node2->worldPosition, node1->velocity, node2->velocity, restLength, hookCoef, dampCoef);
+    }
+
+    /*
+     * force on the first end of a spring between p1 and p2, for kernels that keep the coefficients in arrays
+     */
+    static glm::vec3 force(const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& v1, const glm::vec3& v2,
+        float restLength, float hookCoef, float dampCoef)
+    {
+        float currentLength = glm::distance(p1, p2);
         // restrain min length; otherwise force will be very large
         // currentLength = std::max(currentLength, restLength / 50);
-        // todo: currentLength should have upper limit
-        
-        glm::vec3 forceDirection = (node2->worldPosition - node1->worldPosition) / currentLength;
-        glm::vec3 velocityDifference = node2->velocity - node1->velocity;
-        glm::vec3 force = forceDirection * ((currentLength - restLength) * hookCoef + glm::dot(velocityDifference, forceDirection) * dampCoef);
+        // the upper limit of currentLength is kept by Cloth::strainLimit, see strainCorrection()
 
-        node1->addForce(force);
-        node2->addForce(-force);
-        //velocityModification();
+        glm::vec3 forceDirection = (p2 - p1) / currentLength;
+        glm::vec3 velocityDifference = v2 - v1;
+        return forceDirection * ((currentLength - restLength) * hookCoef + glm::dot(velocityDifference, forceDirection) * dampCoef);
     }
 
     /*
-     * constraining super-elasticity
+     * constraining super-elasticity (Provot)
      * After each iteration it checks for each spring whether it exceeds its natural length by a pre-given threshold
-     * If this is the case, the velocities are modified, so that further elongation is not allowed
-     * Let p1 and p2 be the positions of the end points of a spring found as over-elongated
-     * Decompose v1 and v2, and set vt to zero to avoid over-stretching
+     * If this is the case, both ends are moved back to that length, and the velocities are modified,
+     * so that further elongation is not allowed: the part of v2 - v1 along the spring is removed
+     * returns false if the spring is not over-elongated; dx and dv are for node1, node2 gets the opposite ones
      */
-    // void velocityModification() {}
+    bool strainCorrection(float maxStrain, glm::vec3& dx, glm::vec3& dv) const
+    {
+        const glm::vec3 d = node2->worldPosition - node1->worldPosition;
+        const float currentLength = glm::length(d);
+        const float maxLength = restLength * (1.0f + maxStrain);
+        if (currentLength <= maxLength || currentLength == 0.0f) {
+            return false;
+        }
+        const glm::vec3 direction = d / currentLength;
+        dx = direction * ((currentLength - maxLength) * 0.5f);
+        const float stretching = glm::dot(node2->velocity - node1->velocity, direction);
+        dv = stretching > 0.0f ? direction * (stretching * 0.5f) : glm::vec3(0.0f);
+        return true;
+    }
 };
 
 #endif
@@ -0,0 +1,160 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * fixed set of worker threads that split index ranges between them
+ * the calling thread works on the range too; nested or concurrent calls fall back to running serially
+ */
+class ThreadPool
+{
+public:
+    ThreadPool(size_t threadCount = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        stopping = false;
+        generation = 0;
+        pending = 0;
+        job = nullptr;
+        jobCount = jobGrain = 0;
+        for (size_t i = 1; i < threadCount; i++) {
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : workers) {
+            t.join();
+        }
+    }
+
+    size_t size() const { return workers.size() + 1; }
+
+    /*
+     * call fn(begin, end) on chunks of at most 'grain' indices covering [0, count)
+     * returns once every chunk has finished
+     */
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+    {
+        if (count == 0) {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+        if (workers.empty() || count <= grain || insideJob() || !submitMutex.try_lock()) {
+            fn(0, count);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            jobCount = count;
+            jobGrain = grain;
+            next = 0;
+            pending = workers.size();
+            generation += 1;
+        }
+        wake.notify_all();
+
+        insideJob() = true;
+        runChunks();
+        insideJob() = false;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [this] { return pending == 0; });
+            job = nullptr;
+        }
+        submitMutex.unlock();
+    }
+
+    /*
+     * one call per index
+     */
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn)
+    {
+        parallelFor(count, 1, [&fn](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                fn(i);
+            }
+        });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex submitMutex;             // one job at a time
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const std::function<void(size_t, size_t)>* job;
+    size_t jobCount;
+    size_t jobGrain;
+    std::atomic<size_t> next;
+    size_t pending;                     // workers that have not finished the current job
+    uint64_t generation;                // incremented for every job so workers never run one twice
+    bool stopping;
+
+    static bool& insideJob()
+    {
+        static thread_local bool inside = false;
+        return inside;
+    }
+
+    void runChunks()
+    {
+        for (;;) {
+            size_t begin = next.fetch_add(jobGrain);
+            if (begin >= jobCount) {
+                break;
+            }
+            (*job)(begin, std::min(begin + jobGrain, jobCount));
+        }
+    }
+
+    void workerLoop()
+    {
+        insideJob() = true;
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            runChunks();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) {
+                    finished.notify_one();
+                }
+            }
+        }
+    }
+};
+
+/*
+ * pool shared by the whole process, created on first use
+ */
+inline ThreadPool& threadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+#endif